@@ -1,50 +1,287 @@
 from coapthon.client.helperclient import HelperClient
+from coapthon.server.coap import CoAP
+from coapthon.resources.resource import Resource
+from coapthon import defines
 import json
 import time
 import datetime
+import queue
+import threading
 import pymysql
 
+# OSCORE needs aiocoap, only for the nodes with a provisioned security context
+try:
+    from oscore_client import OscoreClient, has_context
+except ImportError:
+    OscoreClient = None
+
 # Database connection 
 db = pymysql.connect(host="localhost", user="root", password="root", db="patientdata")
 cursor = db.cursor()
  
- # IPv6 addresses of NORDIC Dongle devices
-#host = "fd00::f6ce:36a7:5fc6:567"
-host = "fd00::f6ce:3631:85d:5f3a"
-
-# Cooja simulation IPv6 addresses 
-#host = "fd00::202:2:2:2"
-#host = "fd00::203:3:3:3"
-#host = "fd00::204:4:4:4"
+# The nodes are no longer listed here: they register themselves (NORDIC
+# dongles or Cooja motes alike) on the registration resource of the collector
 
 # CoAP server port 
 port = 5683
+# Path of the registration resource, and lifetime used when a node gives none
+registration_path = "registration"
+default_lifetime = 300
 # CoAP resource paths for different operations
-get_path = "glucose/level" # Path to get glucose level
-put_insulin_path = "glucose_control/insulin" # Path to control insulin actuator
-put_glucagon_path = "glucose_control/glucagon" # Path to control glucagon actuator
-put_alert_path = "glucose_control/alert" # Path to control alert actuator
+get_path = "glucose/level" # Path to observe glucose level
+history_path = "glucose/history" # Path to read the samples stored on the node
+state_path = "glucose_control/state" # Path to observe the insulin, glucagon and alert actuators
+config_path = "glucose_control/config" # Path to configure the glucose controller running on the node
+sampling_path = "glucose_control/sampling" # Path to configure the adaptive sampling of the node
+
+# Thresholds (mg/dL) pushed to the controller of every node
+controller_config = "high=180&insulin=120&glucagon=70&low=50&auto=ON"
+
+# Adaptive sampling of every node: every min to max seconds, at the minimum while
+# glucose changes by rate mg/dL per minute or more, or is within margin mg/dL of
+# a controller threshold
+sampling_config = "min=5&max=60&rate=2&margin=20"
+
+# Conditional observe attributes of the glucose notifications: at most one every
+# pmin seconds, at least one every pmax seconds, otherwise only on a change of
+# step mg/dL or when the level crosses below lt or above gt
+observe_conditions = "pmin=5&pmax=300&step=10&lt=70&gt=180"
+
+# CoAP content formats for the glucose readings
+JSON_FORMAT = 50
+CBOR_FORMAT = 60
+# Encoding asked to the nodes with the Accept option (JSON_FORMAT or CBOR_FORMAT)
+accept_format = CBOR_FORMAT
+
+# Notifications received from the observed nodes, consumed by the main loop.
+# The CoAP receive threads only enqueue, so that all the database work
+# happens in the main thread.
+notifications = queue.Queue()
+
+# Sequence number of the newest stored sample already read from each node
+last_sequence = {}
+
+# Registered nodes: host -> {'expiry': time, 'resources': [...]}, shared with the
+# CoAP server thread
+registrations = {}
+registrations_lock = threading.Lock()
+
+
+class RegistrationResource(Resource):
+    """Registration resource of the collector, in the style of a resource directory.
+
+    A node POSTs its resource list in link format ("</glucose/level>,...") with its
+    lifetime in seconds and the role of this collector in the query
+    ("lt=300&role=primary"); the CoAP server reassembles the Block1 transfer.
+    A POST without payload refreshes an existing registration and is answered
+    "Unknown" if the collector does not know the node, so that the node registers
+    again. Registrations that are not refreshed within their lifetime expire and
+    their observations are stopped.
+
+    A node registers with several collectors: only its primary observes it, the
+    standbys keep the registration and take over when the node switches to them.
+    """
+
+    def __init__(self, name="RegistrationResource"):
+        super(RegistrationResource, self).__init__(name)
+
+    def render_POST_advanced(self, request, response):
+        host = request.source[0]
+        lifetime = default_lifetime
+        role = "primary"
+        restarted = False
+        for option in (request.uri_query or "").split("&"):
+            if option.startswith("lt=") and option[3:].isdigit():
+                lifetime = int(option[3:])
+            elif option.startswith("role="):
+                role = option[5:]
+            elif option == "boot=1":
+                # Refresh of a node restarted from its saved registration
+                restarted = True
+        resources = [link.strip("<>") for link in (request.payload or "").split(",") if link]
+
+        with registrations_lock:
+            known = host in registrations
+            if not resources and not known:
+                response.payload = "Unknown"
+                response.code = defines.Codes.NOT_FOUND.number
+                return self, response
+            if resources:
+                registrations[host] = {'resources': resources, 'role': None}
+            changed = bool(resources) or restarted or registrations[host]['role'] != role
+            registrations[host]['role'] = role
+            registrations[host]['expiry'] = time.time() + lifetime
+
+        if changed:
+            # New registration or new role: let the main loop start or stop the observations
+            notifications.put((host, registration_path, (role, bool(resources) or restarted)))
+        response.payload = "Success"
+        response.code = defines.Codes.CHANGED.number if known else defines.Codes.CREATED.number
+        return self, response
+
+
+def expire_registrations():
+    """Return the hosts whose registration was not refreshed within its lifetime."""
+    now = time.time()
+    with registrations_lock:
+        expired = [host for host, registration in registrations.items() if registration['expiry'] < now]
+        for host in expired:
+            del registrations[host]
+    return expired
+
+
+def observe_node(host):
+    """Configure the controller of a node and observe its glucose level and actuator states.
+
+    A HelperClient handles a single observe relationship and shares its response
+    queue with the plain requests, so every observation gets its own client.
+    A node with an OSCORE security context is configured and observed through a
+    single OscoreClient, which owns the sequence number of the context; the
+    history stays plain CoAP.
+    Returns the clients created for the node.
+    """
+    client = HelperClient(server=(host, port))
+    backfill_history(client, host)
+
+    secure = None
+    if OscoreClient is not None and has_context(host):
+        secure = OscoreClient(server=(host, port))
+        print(f"Using OSCORE with [{host}]")
+    configure_controller(secure or client, host)
+
+    observers = [secure] if secure else []
+    for path, query, options in ((get_path, observe_conditions, {'accept': accept_format}), (state_path, "", {})):
+        observer = secure or HelperClient(server=(host, port))
+        uri = f"{path}?{query}" if query else path
+        observer.observe(uri, lambda response, path=path: notifications.put((host, path, response)), **options)
+        print(f"Observing {path} on [{host}]:{port}")
+        if not secure:
+            observers.append(observer)
+    return [client] + observers
+
+
+def configure_controller(client, host):
+    """Push the thresholds of the glucose controller and the sampling bounds of the node."""
+    response = client.put(config_path, controller_config)
+    if response:
+        print(f"Controller of [{host}] configured: {controller_config}")
+    else:
+        print("Controller configuration failed. Check server availability or path")
+
+    response = client.put(sampling_path, sampling_config)
+    if response:
+        print(f"Sampling of [{host}] configured: {sampling_config}")
+    else:
+        print("Sampling configuration failed. Check server availability or path")
+
+
+def newest_sequence(response):
+    """Sequence number of the newest sample of the node, carried as ETag by the history, or None."""
+    for etag in response.etag or []:
+        if isinstance(etag, str):
+            etag = etag.encode("utf-8", "surrogateescape")
+        if len(etag) == 4:
+            return int.from_bytes(etag, "big")
+    return None
+
+
+def backfill_history(client, host):
+    """Read the samples stored on the node since the last backfill and write them to the database.
+
+    The whole history comes back in one Block2 transfer. The newest sample is
+    skipped because the observe registration delivers it right afterwards.
+    A node restarted without a saved state numbers its samples from 0 again:
+    when its newest sample is older than the last one read, the whole history
+    is read.
+    """
+    since = last_sequence.get(host, 0)
+    response = client.get(f"{history_path}?since={since}")
+    newest = newest_sequence(response) if response else None
+    if newest is not None and newest < since:
+        print(f"Sequence numbers of [{host}] restarted from {newest}, reading the whole history")
+        response = client.get(f"{history_path}?since=0")
+    if not response or not response.payload:
+        print(f"No history received from [{host}]")
+        return
+    try:
+        data = json.loads(response.payload)
+    except json.JSONDecodeError:
+        print("Failed to decode JSON history from response.")
+        return
+
+    samples = data.get('samples', [])
+    if not samples:
+        return
+    # Sample timestamps are node uptimes: the newest one is taken as "now"
+    now = datetime.datetime.now()
+    newest_timestamp = samples[-1][1]
+    for seq, timestamp, glucose_level in samples[:-1]:
+        incoming_timestamp = now - datetime.timedelta(seconds=newest_timestamp - timestamp)
+        write_sensor_data(data.get('patient_Id', 'Not specified'), glucose_level, incoming_timestamp)
+    last_sequence[host] = samples[-1][0]
+    print(f"Backfilled {len(samples) - 1} samples from [{host}]")
+
 
-# Create a CoAP client instance
-client = HelperClient(server=(host, port))
+def decode_cbor(data, pos=0):
+    """Decode the CBOR item starting at data[pos].
+
+    Only the types sent by the nodes are supported: integers, arrays and maps.
+    Returns the decoded value and the position following it.
+    """
+    major = data[pos] >> 5
+    info = data[pos] & 0x1f
+    pos += 1
+    if info < 24:
+        arg = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise ValueError(f"Unsupported CBOR additional info {info}")
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = decode_cbor(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        items = {}
+        for _ in range(arg):
+            key, pos = decode_cbor(data, pos)
+            items[key], pos = decode_cbor(data, pos)
+        return items, pos
+    raise ValueError(f"Unsupported CBOR major type {major}")
+
+
+def decode_glucose_payload(response):
+    """Decode a glucose reading into a dictionary, according to its content format."""
+    if response.content_type == CBOR_FORMAT:
+        payload = response.payload
+        if isinstance(payload, str):
+            payload = payload.encode("utf-8", "surrogateescape")
+        data, _ = decode_cbor(payload)
+        return {'patient_Id': data.get(0), 'glucose_level': data.get(1)}
+    return json.loads(response.payload)
 
 
-#get glucose level from sensor
-def get_sensor_data(path):
+#handle a glucose level notification pushed by a sensor
+def get_sensor_data(response):
     print("\n")
     print("****************GLUCOSE LEVEL MONITORING*******************************")
-    print("Sending GET request to read sensor data...")
-    
-    # Send a GET request to the specified path and store the response
-    response = client.get(path)
     
     # Check if a response is received
-    if response:
+    if response and response.payload:
         
         try:
-            # Parse the response payload from JSON to a Python dictionary
-            data = json.loads(response.payload) 
-            print(f"Response received from GET request: {data}")
+            # Parse the response payload from JSON or CBOR to a Python dictionary
+            data = decode_glucose_payload(response)
+            print(f"Notification received: {data}")
             
             # Extract patient ID and glucose level from the response dictionary
             patient_id = data.get('patient_Id', 'Not specified')
@@ -52,8 +289,8 @@ def get_sensor_data(path):
             incoming_timestamp = datetime.datetime.now()
             # Write the extracted data to the database, I have a explicit function to handle this call
             write_sensor_data(patient_id, glucose_level, incoming_timestamp)
-        except json.JSONDecodeError:
-            print("Failed to decode JSON from response.")
+        except (ValueError, IndexError, AttributeError):
+            print("Failed to decode the glucose reading from response.")
     else:
         print("No response. Check server availability or path")
         
@@ -70,136 +307,70 @@ def write_sensor_data(patient_id, glucose_level, incoming_timestamp):
         print("Failed to insert data into database:", e)
 
         
-# To calcualte average of latest 10 glucose level readings
-def calculate_average_glucose():
-    query = """
-    SELECT glucose_level 
-    FROM glucose_monitoring 
-    ORDER BY incoming_timestamp DESC 
-    LIMIT 10
-    """
-    try:
-        cursor.execute(query)
-        results = cursor.fetchall()
-        if results:
-            total_glucose = sum(result[0] for result in results)
-            average_glucose = total_glucose / len(results)
-            return average_glucose
-        else:
-            print("No records found.")
-            return None
-    except Exception as e:
-        print(f"Failed to fetch and calculate average glucose: {e}")
-        return None
-        
+#report the actuator states notified by a node
+def report_actuator_state(host, response):
+    if not response or not response.payload:
+        print("No response. Check server availability or path")
+        return
+    state = dict(item.split("=", 1) for item in response.payload.split("&") if "=" in item)
+    print(f"Actuators of [{host}]: {state}")
 
-#excuting Logic based on the calculated averages
-def manage_glucose_levels(average_glucose):
-    if average_glucose > 180:
-        deactivate_glucagon(put_glucagon_path)
-        activate_insulin(put_insulin_path)
-        activate_alert(put_alert_path)
+    if state.get('alert') == "ON":
         print("\033[91m>>>Alert is calling!\033[0m")
-        
-    elif 120 < average_glucose <= 180:
-        deactivate_glucagon(put_glucagon_path)
-        activate_insulin(put_insulin_path)
-        deactivate_alert(put_alert_path)
+    elif state.get('insulin') == "ON":
         print("\033[93m>>>Insuline automatically activated\033[0m")
-        
-    elif 70 < average_glucose <= 120:
-        deactivate_glucagon(put_glucagon_path)
-        deactivate_insulin(put_insulin_path)
-        deactivate_alert(put_alert_path)
-        print("\033[92m>>>Normal state\033[0m")
-        
-    elif 50 < average_glucose <= 70:
-        activate_glucagon(put_glucagon_path)
-        deactivate_insulin(put_insulin_path)
-        deactivate_alert(put_alert_path)
+    elif state.get('glucagon') == "ON":
         print("\033[93m>>>glucagon automatically activated\033[0m")
-        
-    elif average_glucose <= 50:
-        activate_glucagon(put_glucagon_path)
-        deactivate_insulin(put_insulin_path)
-        activate_alert(put_alert_path)
-        print("\033[91m>>>Alert is calling!\033[0m")
+    else:
+        print("\033[92m>>>Normal state\033[0m")
+      
 
-    """
-    The function below are for Controlling the actuators 
-    by sending a PUT request to the CoAP server.
+# Clients observing each registered node
+clients = {}
 
-    Args:
-        path: The CoAP resource path to control the actuators.
-    """
-def activate_insulin(path):
-    payload = "status=ON"
-    #print("Activating insulin...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Insulin activation failed. Check server availability or path")
-        
-def deactivate_insulin(path):
-    payload = "status=OFF"
-    #print("Deactivating insulin...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Insulin deactivation failed. Check server availability or path")
 
-def activate_glucagon(path):
-    payload = "status=ON"
-    #print("Activating Glucagon...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Glucagon activation failed. Check server availability or path")
+def stop_node(host):
+    for client in clients.pop(host, []):
+        client.stop()
 
-def deactivate_glucagon(path):
-    payload = "status=OFF"
-    #print("Deactivating Glucagon...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Glucagon deactivation failed. Check server availability or path")
- 
-        
-def activate_alert(path):
-    payload = "status=ON"
-    #print("Activating Alert!...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Alert activation failed. Check server availability or path")
 
-def deactivate_alert(path):
-    payload = "status=OFF"
-    #print("Deactivating Alert...")
-    response = client.put(path, payload)
-    if response:
-        pass #print(response.pretty_print())
-    else:
-        print("Alert deactivation failed. Check server availability or path")
-      
+# Registration server, served from its own thread
+server = CoAP(("::", port))
+server.add_resource(registration_path + "/", RegistrationResource())
+server_thread = threading.Thread(target=server.listen, args=(10,), daemon=True)
+server_thread.start()
+
 try:  
     while True:
-    	path = get_path
-    	get_sensor_data(path)
-    	average_glucose = calculate_average_glucose()
-    	
-    	if average_glucose is not None:
-    	    manage_glucose_levels(average_glucose)
-    	    print(f"Average Glocose_level for the last 10 entries: {average_glucose}\n")
-    	#get glucose level every 10 second and act based on the recieved data  
-    	time.sleep(5)
+    	# Wait for the next notification pushed by any of the observed nodes, or for
+    	# a registration: the glucose control itself runs on the nodes
+    	try:
+    	    host, path, response = notifications.get(timeout=1)
+    	except queue.Empty:
+    	    path = None
+    	if path == registration_path:
+    	    role, full = response
+    	    print(f"Node [{host}] registered, collector is {role}")
+    	    if role == "primary" and (full or host not in clients):
+    	        # A node registering again or refreshing after a warm restart has
+    	        # rebooted: observe it from scratch.
+    	        # A node switching over from another collector is backfilled first.
+    	        stop_node(host)
+    	        clients[host] = observe_node(host)
+    	    elif role != "primary":
+    	        stop_node(host)
+    	elif path == get_path:
+    	    get_sensor_data(response)
+    	elif path == state_path:
+    	    report_actuator_state(host, response)
+
+    	for host in expire_registrations():
+    	    print(f"Registration of [{host}] expired")
+    	    stop_node(host)
 except Exception as e:
     print(f"An error occurred: {e}")
 finally:
 
-    client.stop()
+    for host in list(clients):
+        stop_node(host)
+    server.close()
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Send an actuator command to every glucose node of the ward at once.
+
+The nodes join a realm-local multicast group and accept non-confirmable PUTs
+on glucose_control/<actuator> and glucose_control/state sent to it, without
+answering. MPL only floods the packets seeded inside the DODAG, so the command
+goes as one CoAP message to the group relay of the border router, which sends
+it on to the group:
+
+    python3 group_command.py alert ON
+    python3 group_command.py alert OFF --relay fd00::201:1:1:1
+
+For comparison, --unicast sends the same command as one confirmable PUT per
+node, one after the other, as the collector does for a single node:
+
+    python3 group_command.py alert ON --unicast fd00::202:2:2:2 fd00::203:3:3:3
+"""
+import argparse
+import os
+import socket
+import struct
+import time
+
+from coapthon.client.helperclient import HelperClient
+
+# Address of the border router (node 1 of the Cooja simulations) and its relay port
+default_relay = "fd00::201:1:1:1"
+relay_port = 5690
+# CoAP port of the nodes
+port = 5683
+# Actuator resources of the nodes
+actuator_prefix = "glucose_control/"
+# DSCP of the alert traffic (common/traffic_class.h): the border router and the
+# nodes forward the commands as alert traffic, in the alert cell of TSCH
+ALERT_DSCP = 46
+
+# CoAP header fields and options used by the group request
+TYPE_NON = 1
+PUT = 3
+OPTION_URI_PATH = 11
+OPTION_CONTENT_FORMAT = 12
+
+
+def encode_option(delta, value):
+    """Encode one option whose number delta is below 13 and length below 269."""
+    if len(value) < 13:
+        return bytes([(delta << 4) | len(value)]) + value
+    return bytes([(delta << 4) | 13, len(value) - 13]) + value
+
+
+def encode_group_request(path, payload):
+    """Build a non-confirmable PUT of a text/plain payload to path."""
+    token = os.urandom(4)
+    mid = struct.unpack("!H", os.urandom(2))[0]
+    message = struct.pack("!BBH", (1 << 6) | (TYPE_NON << 4) | len(token), PUT, mid) + token
+    last = 0
+    for segment in path.split("/"):
+        message += encode_option(OPTION_URI_PATH - last, segment.encode())
+        last = OPTION_URI_PATH
+    message += encode_option(OPTION_CONTENT_FORMAT - last, b"")  # text/plain
+    return message + b"\xff" + payload.encode()
+
+
+def alert_socket():
+    """UDP socket sending with the alert DSCP in the IPv6 Traffic Class."""
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IPV6, socket.IPV6_TCLASS, ALERT_DSCP << 2)
+    return sock
+
+
+def send_group_command(actuator, status, relay=default_relay):
+    """Set the actuator of every node of the group with a single packet."""
+    message = encode_group_request(actuator_prefix + actuator, f"status={status}")
+    with alert_socket() as sock:
+        sock.sendto(message, (relay, relay_port, 0, 0))
+    print(f"{actuator}={status} sent to the group through [{relay}]")
+
+
+def send_unicast_commands(actuator, status, hosts):
+    """Set the actuator of every node with one confirmable PUT each."""
+    start = time.monotonic()
+    for host in hosts:
+        client = HelperClient(server=(host, port), sock=alert_socket())
+        try:
+            response = client.put(actuator_prefix + actuator, f"status={status}", timeout=30)
+            print(f"[{host}]: {response.code if response else 'no answer'}")
+        finally:
+            client.stop()
+    print(f"{actuator}={status} sent to {len(hosts)} nodes in {time.monotonic() - start:.2f} s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Actuator command for all the glucose nodes")
+    parser.add_argument("actuator", help="actuator to set, e.g. alert, insulin, glucagon")
+    parser.add_argument("status", choices=["ON", "OFF"])
+    parser.add_argument("--relay", default=default_relay, help="address of the border router")
+    parser.add_argument("--unicast", nargs="+", metavar="HOST", help="send one PUT per node instead")
+    args = parser.parse_args()
+    if args.unicast:
+        send_unicast_commands(args.actuator, args.status, args.unicast)
+    else:
+        send_group_command(args.actuator, args.status, args.relay)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,11 +1,34 @@
 import paho.mqtt.client as mqtt
 import json
+import struct
 import time
 import datetime
 import pymysql
 
 alert_active = False
 
+# Samples older than this (seconds), published late from the queue of a node
+# after an outage, are stored but do not raise an alert any more
+alert_max_age = 60
+
+# Binary payload of the CVD nodes (see mqtt-network/CVD.c): a header with the
+# format, patient ID, MAC address, samples dropped and held by the node and
+# number of records, then one record per sample
+PAYLOAD_FORMAT = 0x01
+PAYLOAD_HEADER = struct.Struct(">BH6sHHB")
+PAYLOAD_RECORD = struct.Struct(">HBBB")  # age, heart rate, blood pressure, button
+
+# Emergency button press, published at once by the node on its own topic:
+# format, patient ID, MAC address, boot of the node, number of the press since
+# that boot, milliseconds from the press to the publish, attempt
+EMERGENCY_TOPIC = "Heart/Emergency"
+EMERGENCY_FORMAT = 0x03
+EMERGENCY = struct.Struct(">BH6sHHHB")
+
+# Last press received from each node, as (boot, press), to drop the publishes
+# sent again; the press numbers start again at every boot of the node
+last_press = {}
+
 # MQTT broker settings
 broker_address = "127.0.0.1"
 broker_port = 1883
@@ -21,6 +44,8 @@ def on_connect(app_mqtt_client, userdata, flags, rc):
     connection_status = 1
     # Subscribe to sensor data topic (receives the data in json format)
     app_mqtt_client.subscribe("Heart/Data")
+    # Button presses, sent by the nodes with QoS 1 ahead of the telemetry
+    app_mqtt_client.subscribe(EMERGENCY_TOPIC, qos=1)
    
    
 def on_disconnect(app_mqtt_client, userdata, rc):
@@ -33,20 +58,30 @@ def on_message(app_mqtt_client, userdata, msg):
         return 
     global alert_active
     print("\n******************Cardiovascular Monitoring*************************\nReceived message on topic: " + str(msg.topic))#  + "\n"+ str(msg.payload.decode()))
+    if msg.topic == EMERGENCY_TOPIC:
+        handle_emergency(msg.payload)
+        return
     # Parsing the incoming message
     incoming_timestamp = datetime.datetime.now()
-    msg_string = msg.payload.decode()
-    msg_json = json.loads(msg_string)
+    try:
+        msg_json = decode_message(msg.payload)
+    except (ValueError, KeyError, struct.error) as e:
+        print("Failed to decode the message:", e)
+        return
     
-    # Extract data from JSON
+    # Extract the data
     patientId = msg_json["patientId"]
     client_id = msg_json["client_id"]
-    heart_rate = msg_json["heart_rate"]
-    blood_pressure = msg_json["blood_pressure"]
-    button = msg_json["button"]
     
-    # write the data in the mysql table
-    write_sensor_data(patientId, client_id, heart_rate, blood_pressure, button, incoming_timestamp)
+    # write the data in the mysql table, one row per sample of the batch
+    samples = msg_json["samples"]
+    for age, heart_rate, blood_pressure, sample_button in samples:
+        sample_timestamp = incoming_timestamp - datetime.timedelta(seconds=age)
+        write_sensor_data(patientId, client_id, heart_rate, blood_pressure, sample_button, sample_timestamp)
+    button = int(any(sample[3] for sample in samples if sample[0] <= alert_max_age))
+    if msg_json.get("dropped") or msg_json.get("backlog", 0) > len(samples):
+        # Store and forward queue of the node, after an outage
+        print(f"Node {client_id}: {msg_json.get('backlog')} samples held, {msg_json.get('dropped')} dropped")
     
      # Check emergency
     average_bp = get_average_blood_pressure(patientId)
@@ -75,6 +110,53 @@ def on_message(app_mqtt_client, userdata, msg):
             if (not alert_active):
                 print("\033[92m>>>Normal state\033[0m")    
            	      
+def decode_message(payload):
+    """Decode a Heart/Data message into a dictionary with a list of samples.
+
+    Every sample is [age, heart_rate, blood_pressure, button], its age being in
+    seconds at the time of the publish. The nodes send binary records; JSON
+    messages, batched or with a single reading, are still accepted.
+    """
+    if not payload:
+        raise ValueError("empty payload")
+    if payload[0] == PAYLOAD_FORMAT:
+        _, patient_id, mac, dropped, backlog, count = PAYLOAD_HEADER.unpack_from(payload)
+        if len(payload) != PAYLOAD_HEADER.size + count * PAYLOAD_RECORD.size:
+            raise ValueError(f"{len(payload)} bytes for {count} records")
+        samples = [list(PAYLOAD_RECORD.unpack_from(payload, PAYLOAD_HEADER.size + i * PAYLOAD_RECORD.size))
+                   for i in range(count)]
+        return {"patientId": patient_id, "client_id": mac.hex(), "dropped": dropped,
+                "backlog": backlog, "samples": samples}
+
+    msg_json = json.loads(payload.decode())
+    if "samples" not in msg_json:
+        msg_json["samples"] = [[0, msg_json["heart_rate"], msg_json["blood_pressure"], msg_json["button"]]]
+    return msg_json
+
+
+def handle_emergency(payload):
+    """Raise the alert for a button press and report its latency.
+
+    The node publishes the press again until the broker acknowledges it, so
+    the same press may arrive more than once. The delay is measured on the node
+    from the press to the publish that got here; the node logs the time to the
+    PUBACK as well, which bounds the press-to-broker latency from above.
+    """
+    global alert_active
+    try:
+        payload_format, patientId, mac, boot, press, delay, attempt = EMERGENCY.unpack(payload)
+    except struct.error as e:
+        print("Failed to decode the emergency:", e)
+        return
+    if payload_format != EMERGENCY_FORMAT or last_press.get(mac) == (boot, press):
+        return
+    last_press[mac] = (boot, press)
+    app_mqtt_client.publish("Emergency_Alert", payload="ON")
+    alert_active = True
+    print(f"\033[91m>>>Emergency button pressed by patient {patientId} ({mac.hex()}): "
+          f"published {delay} ms after the press, attempt {attempt}\033[0m")
+
+
 # atempts of reconnection to MQTT broker
 def mqtt_reconnect():
     print("Attempt to reconnect to broker... ")
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""MQTT-SN gateway between the CVD nodes built with MAKE_WITH_MQTT_SN=1 and the broker.
+
+A transparent gateway (MQTT-SN 1.2): every node that connects over UDP gets its
+own MQTT connection to Mosquitto, with the client ID of the node, so mqtt.py
+sees the same publishes as from the nodes speaking MQTT over TCP:
+
+    python3 mqtt_sn_gateway.py
+    python3 mqtt_sn_gateway.py --broker 127.0.0.1 --port 1884
+
+The nodes only use pre-registered topic IDs, the same as in
+mqtt-network/mqtt-sn.c. A QoS 1 publish of a node is acknowledged to it once
+the broker acknowledged it. The nodes subscribe with QoS 0, so the messages of
+the broker are forwarded to them as QoS 0 publishes.
+"""
+import argparse
+import socket
+import struct
+import threading
+
+import paho.mqtt.client as mqtt
+
+# Topics pre-registered on the nodes
+TOPICS = {1: "Heart/Data", 2: "Emergency_Alert", 3: "Heart/Emergency"}
+TOPIC_IDS = {name: topic_id for topic_id, name in TOPICS.items()}
+
+# Message types, flags and return codes of MQTT-SN 1.2
+CONNECT, CONNACK = 0x04, 0x05
+PUBLISH, PUBACK = 0x0C, 0x0D
+SUBSCRIBE, SUBACK = 0x12, 0x13
+PINGREQ, PINGRESP = 0x16, 0x17
+DISCONNECT = 0x18
+FLAG_CLEAN_SESSION = 0x04
+FLAG_TOPIC_PREDEFINED = 0x01
+QOS_SHIFT = 5
+ACCEPTED, CONGESTION, INVALID_TOPIC = 0x00, 0x01, 0x02
+
+
+def message(msg_type, body=b""):
+    """Frame an MQTT-SN message with the one-byte length field."""
+    return bytes([len(body) + 2, msg_type]) + body
+
+
+class Node:
+    """MQTT connection to the broker on behalf of one node."""
+
+    def __init__(self, gateway, address, client_id, keep_alive, clean_session):
+        self.gateway = gateway
+        self.address = address
+        self.lock = threading.Lock()
+        # MQTT message ID of a publish -> (topic ID, MQTT-SN message ID) of the node
+        self.publishes = {}
+        self.client = mqtt.Client(client_id=client_id, clean_session=clean_session)
+        self.client.on_connect = self.on_connect
+        self.client.on_publish = self.on_publish
+        self.client.on_message = self.on_message
+        self.client.connect_async(gateway.broker, gateway.broker_port, max(keep_alive, 10))
+        self.client.loop_start()
+
+    def on_connect(self, client, userdata, flags, rc):
+        self.gateway.send(self.address, message(CONNACK, bytes([ACCEPTED if rc == 0 else CONGESTION])))
+
+    def publish(self, topic_id, mid, qos, retain, payload):
+        with self.lock:
+            info = self.client.publish(TOPICS[topic_id], payload, qos=qos, retain=retain)
+            if qos > 0:
+                self.publishes[info.mid] = (topic_id, mid)
+
+    def on_publish(self, client, userdata, broker_mid):
+        with self.lock:
+            acknowledged = self.publishes.pop(broker_mid, None)
+        if acknowledged:
+            topic_id, mid = acknowledged
+            self.gateway.send(self.address, message(PUBACK, struct.pack("!HHB", topic_id, mid, ACCEPTED)))
+
+    def subscribe(self, topic_id, mid):
+        self.client.subscribe(TOPICS[topic_id], qos=0)
+        self.gateway.send(self.address, message(SUBACK, struct.pack("!BHHB", 0, topic_id, mid, ACCEPTED)))
+
+    def on_message(self, client, userdata, msg):
+        topic_id = TOPIC_IDS.get(msg.topic)
+        if topic_id is not None:
+            body = struct.pack("!BHH", FLAG_TOPIC_PREDEFINED, topic_id, 0) + msg.payload
+            self.gateway.send(self.address, message(PUBLISH, body))
+
+    def stop(self):
+        self.client.disconnect()
+        self.client.loop_stop()
+
+
+class Gateway:
+    def __init__(self, port, broker, broker_port):
+        self.broker = broker
+        self.broker_port = broker_port
+        self.nodes = {}
+        self.sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+        self.sock.bind(("::", port))
+        print(f"MQTT-SN gateway on UDP port {port}, broker {broker}:{broker_port}")
+
+    def send(self, address, data):
+        self.sock.sendto(data, address)
+
+    def serve(self):
+        while True:
+            data, address = self.sock.recvfrom(1024)
+            if len(data) < 2 or data[0] != len(data):
+                continue
+            try:
+                self.handle(address, data[1], data[2:])
+            except (struct.error, KeyError) as e:
+                print(f"Malformed message from [{address[0]}]: {e}")
+
+    def handle(self, address, msg_type, body):
+        node = self.nodes.get(address)
+        if msg_type == CONNECT:
+            flags, _, keep_alive = struct.unpack_from("!BBH", body)
+            client_id = body[4:].decode()
+            if node:
+                node.stop()
+            self.nodes[address] = Node(self, address, client_id, keep_alive, bool(flags & FLAG_CLEAN_SESSION))
+            print(f"Node {client_id} connected from [{address[0]}]")
+        elif node is None:
+            # Not connected, e.g. after a restart of the gateway: the node connects again
+            self.send(address, message(DISCONNECT))
+        elif msg_type == PUBLISH:
+            flags, topic_id, mid = struct.unpack_from("!BHH", body)
+            if topic_id not in TOPICS:
+                self.send(address, message(PUBACK, struct.pack("!HHB", topic_id, mid, INVALID_TOPIC)))
+                return
+            qos = (flags >> QOS_SHIFT) & 0x03
+            node.publish(topic_id, mid, qos, bool(flags & 0x10), body[5:])
+        elif msg_type == SUBSCRIBE:
+            _, mid, topic_id = struct.unpack_from("!BHH", body)
+            if topic_id not in TOPICS:
+                self.send(address, message(SUBACK, struct.pack("!BHHB", 0, topic_id, mid, INVALID_TOPIC)))
+                return
+            node.subscribe(topic_id, mid)
+        elif msg_type == PINGREQ:
+            self.send(address, message(PINGRESP))
+        elif msg_type == DISCONNECT:
+            node.stop()
+            del self.nodes[address]
+            self.send(address, message(DISCONNECT))
+            print(f"Node at [{address[0]}] disconnected")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="MQTT-SN gateway for the CVD nodes")
+    parser.add_argument("--port", type=int, default=1884, help="UDP port of the gateway")
+    parser.add_argument("--broker", default="127.0.0.1", help="address of the MQTT broker")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    args = parser.parse_args()
+    Gateway(args.port, args.broker, args.broker_port).serve()
+
+
+if __name__ == "__main__":
+    main()
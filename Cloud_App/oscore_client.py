@@ -0,0 +1,139 @@
+"""OSCORE client for the protected resources of the glucose nodes.
+
+CoAPthon has no OSCORE support, so the requests to glucose/level and
+glucose_control/* of a node built with MAKE_WITH_OSCORE=1 go through aiocoap.
+The security context of each node is pre-provisioned in oscore/<node address>/,
+with "-" in place of ":" in the address (settings.json with the sender and
+recipient IDs, secret.json with the master secret and salt of the node, see
+oscore/example/); aiocoap keeps the sequence number of the collector in the
+same directory, so it survives restarts.
+
+OscoreClient offers the get/put/observe/stop calls of HelperClient used by
+coap.py, running the aiocoap requests on a shared event loop thread.
+"""
+import asyncio
+import os
+import threading
+
+from aiocoap import Context, Message, GET, PUT
+
+# Directory holding one security context per node
+CONTEXTS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "oscore")
+# Resources protected by the nodes. aiocoap matches the credentials on the whole
+# URI, query included, and only as a prefix when the pattern ends in "*": the
+# observation of glucose/level carries the conditional attributes in its query.
+PROTECTED_PATHS = ["glucose/level*", "glucose_control/*"]
+# Seconds to wait for the answer to a request
+REQUEST_TIMEOUT = 30
+
+_loop = None
+_loop_lock = threading.Lock()
+
+
+def _event_loop():
+    """Start the event loop shared by all the clients on first use."""
+    global _loop
+    with _loop_lock:
+        if _loop is None:
+            _loop = asyncio.new_event_loop()
+            threading.Thread(target=_loop.run_forever, daemon=True).start()
+    return _loop
+
+
+def context_dir(host):
+    """Directory of the security context of the node."""
+    return os.path.join(CONTEXTS_DIR, host.replace(":", "-"))
+
+
+def has_context(host):
+    """True if a security context is provisioned for the node."""
+    return os.path.isdir(context_dir(host))
+
+
+def request_uri(host, port, path):
+    """URI of a request to the node, path may carry a query."""
+    return f"coap://[{host}]:{port}/{path}"
+
+
+def credential_patterns(host, port):
+    """URI patterns of the node mapped to its security context."""
+    return [request_uri(host, port, path) for path in PROTECTED_PATHS]
+
+
+class OscoreResponse:
+    """Response with the attributes of the CoAPthon responses read by coap.py."""
+
+    def __init__(self, message):
+        self.code = message.code
+        self.payload = message.payload.decode("utf-8", "surrogateescape")
+        content_format = message.opt.content_format
+        self.content_type = int(content_format) if content_format is not None else None
+
+
+class OscoreClient:
+    """OSCORE client of one node, with the calls of HelperClient."""
+
+    def __init__(self, server):
+        self.host, self.port = server
+        self.observations = []
+        self.context = self._run(self._create_context())
+
+    def _run(self, coroutine):
+        return asyncio.run_coroutine_threadsafe(coroutine, _event_loop()).result(REQUEST_TIMEOUT)
+
+    async def _create_context(self):
+        context = await Context.create_client_context()
+        directory = context_dir(self.host)
+        context.client_credentials.load_from_dict({
+            pattern: {"oscore": {"contextfile": directory}}
+            for pattern in credential_patterns(self.host, self.port)})
+        return context
+
+    def _uri(self, path):
+        return request_uri(self.host, self.port, path)
+
+    async def _request(self, message):
+        response = await self.context.request(message).response
+        return OscoreResponse(response)
+
+    def get(self, path):
+        try:
+            return self._run(self._request(Message(code=GET, uri=self._uri(path))))
+        except Exception as e:
+            print(f"OSCORE request to [{self.host}] failed: {e}")
+            return None
+
+    def put(self, path, payload):
+        try:
+            return self._run(self._request(Message(code=PUT, uri=self._uri(path), payload=payload.encode())))
+        except Exception as e:
+            print(f"OSCORE request to [{self.host}] failed: {e}")
+            return None
+
+    async def _observe(self, message, callback):
+        request = self.context.request(message)
+        self.observations.append(request)
+        try:
+            callback(OscoreResponse(await request.response))
+            async for notification in request.observation:
+                callback(OscoreResponse(notification))
+        except Exception as e:
+            print(f"OSCORE observation of [{self.host}] ended: {e}")
+
+    def observe(self, path, callback, accept=None):
+        """Observe path, calling callback with the first response and every notification."""
+        message = Message(code=GET, uri=self._uri(path), observe=0)
+        if accept is not None:
+            message.opt.accept = accept
+        asyncio.run_coroutine_threadsafe(self._observe(message, callback), _event_loop())
+
+    async def _shutdown(self):
+        for request in self.observations:
+            request.observation.cancel()
+        await self.context.shutdown()
+
+    def stop(self):
+        try:
+            self._run(self._shutdown())
+        except Exception as e:
+            print(f"OSCORE client of [{self.host}] not stopped cleanly: {e}")
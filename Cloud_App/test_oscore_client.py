@@ -0,0 +1,55 @@
+"""Checks that the requests coap.py sends to an OSCORE node resolve to its security context.
+
+    python3 -m unittest test_oscore_client
+"""
+import ast
+import os
+import unittest
+
+try:
+    from aiocoap import GET, PUT, Message
+    from aiocoap.credentials import CredentialsMap, CredentialsMissingError
+    from oscore_client import credential_patterns, request_uri
+except ImportError:
+    Message = None
+
+HOST = "fd00::202:2:2:2"
+PORT = 5683
+
+
+def coap_settings():
+    """The module-level string settings of coap.py, read without importing it (it opens the database)."""
+    with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "coap.py")) as f:
+        tree = ast.parse(f.read())
+    return {target.id: node.value.value
+            for node in tree.body if isinstance(node, ast.Assign) and isinstance(node.value, ast.Constant)
+            for target in node.targets if isinstance(target, ast.Name)}
+
+
+@unittest.skipIf(Message is None, "aiocoap is not installed")
+class CredentialsTest(unittest.TestCase):
+    def setUp(self):
+        self.settings = coap_settings()
+        self.context = object()
+        self.credentials = CredentialsMap()
+        for pattern in credential_patterns(HOST, PORT):
+            self.credentials[pattern] = self.context
+
+    def resolve(self, code, path):
+        return self.credentials.credentials_from_request(Message(code=code, uri=request_uri(HOST, PORT, path)))
+
+    def test_observation_of_glucose_level(self):
+        path = f"{self.settings['get_path']}?{self.settings['observe_conditions']}"
+        self.assertIs(self.resolve(GET, path), self.context)
+
+    def test_controller_configuration(self):
+        for name in ("config_path", "sampling_path", "state_path"):
+            self.assertIs(self.resolve(PUT, self.settings[name]), self.context)
+
+    def test_history_stays_plain(self):
+        with self.assertRaises(CredentialsMissingError):
+            self.resolve(GET, self.settings["history_path"])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,33 @@
+#ifndef ACTUATORS_H
+#define ACTUATORS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "contiki.h"
+#include "coap-engine.h"
+
+//One actuator of the node, exposed as the CoAP resource glucose_control/<key>
+struct actuator {
+	const char *key;            // name of the actuator in URLs and payloads
+	const char *title;          // name printed in the logs
+	const char *path;           // path of the CoAP resource
+	bool *state;                // global flag driven by the actuator
+	coap_resource_t resource;   // CoAP resource controlling the actuator
+};
+
+//Event posted to the actuator_simulation process when an actuator changes state
+extern process_event_t actuator_event;
+
+//Allocates the actuator event and activates the CoAP resource of every actuator
+void actuators_init(void);
+
+//Number of actuators in the table
+size_t actuators_count(void);
+
+//Returns the i-th actuator of the table
+struct actuator *actuators_get(size_t index);
+
+//Signals a change of the actuator states to the actuator process and to the observers
+void actuators_changed(void);
+
+#endif /* ACTUATORS_H */
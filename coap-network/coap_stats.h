@@ -0,0 +1,11 @@
+#ifndef COAP_STATS_H
+#define COAP_STATS_H
+
+//Installs the request counter of the stats/coap resource in the CoAP engine
+void coap_stats_init(void);
+
+//Counts a registration request sent to a collector, and one left unanswered or refused
+void coap_stats_registration_sent(void);
+void coap_stats_registration_failed(void);
+
+#endif /* COAP_STATS_H */
@@ -0,0 +1,20 @@
+#ifndef ENERGY_STATS_H
+#define ENERGY_STATS_H
+
+#include <stdint.h>
+
+//Processes whose CPU time is accounted by the stats/energy resource
+enum {
+	STATS_PROCESS_SERVER,    // glucose_monitoring_server
+	STATS_PROCESS_ACTUATOR,  // actuator_simulation
+	STATS_PROCESS_SENSOR,    // sensor_simulating
+	STATS_PROCESS_COUNT
+};
+
+//Marks the start of an activation of a process, right after it wakes up
+void energy_stats_begin(uint8_t process);
+
+//Marks the end of an activation of a process, right before it waits again
+void energy_stats_end(uint8_t process);
+
+#endif /* ENERGY_STATS_H */
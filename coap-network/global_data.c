@@ -1,6 +0,0 @@
-#include "global_data.h"
-
-bool insulin_activate ;
-bool glucagon_activate;
-bool glucagon_activate;
-int glucose_leve;
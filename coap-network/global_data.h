@@ -1,8 +0,0 @@
-#ifndef GLOBAL_DATA_H
-#define GLOBAL_DATA_H
-
-extern bool insulin_activate;
-extern bool glucagon_activate;
-extern int glucose_level; 
-
-#endif /* GLOBAL_DATA_H */
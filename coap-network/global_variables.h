@@ -2,10 +2,65 @@
 #define GLOBAL_VARIABLES_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+//Identifier of the patient wearing the sensor
+#define PATIENT_ID 1
+
+//Number of samples kept in the on-node glucose history ring
+#define GLUCOSE_HISTORY_SIZE 64
+
+//One timestamped sample of the glucose history
+struct glucose_sample {
+	uint32_t seq;        // sequence number, incremented for every sample
+	uint32_t timestamp;  // node uptime in seconds when the sample was taken, see glucose_uptime()
+	int16_t level;       // glucose level in mg/dL
+};
+
+//Bands of the glucose controller, applied to the rolling average (mg/dL)
+struct glucose_thresholds {
+	int alert_high;  // above: insulin and alert
+	int insulin;     // above: insulin
+	int glucagon;    // at or below: glucagon
+	int alert_low;   // at or below: glucagon and alert
+};
+
+//Bounds of the adaptive sampling of the glucose sensor
+struct sampling_config {
+	uint16_t min_interval;  // interval in seconds used while glucose moves or is near a threshold
+	uint16_t max_interval;  // interval in seconds reached while glucose is stable and in range
+	uint16_t rate;          // rate of change (mg/dL per minute) switching to the minimum interval
+	uint16_t margin;        // distance (mg/dL) from a controller threshold switching to the minimum interval
+};
 
 extern bool insulin_activate;
 extern bool glucagon_activate;
 extern bool alert_activate;
 extern int glucose_level;
 
+//Configuration of the on-node glucose controller
+extern struct glucose_thresholds glucose_thresholds;
+extern bool edge_control_enabled;
+
+//Adaptive sampling, set with glucose_control/sampling
+extern struct sampling_config sampling_config;
+//Current sampling interval in seconds
+extern uint16_t sampling_interval;
+//Applies a new sampling configuration without waiting for the next sample
+void sampling_config_changed(void);
+
+//Number of valid samples in the history ring
+extern uint8_t glucose_history_count;
+
+//Returns the i-th oldest sample of the history ring (0 is the oldest)
+const struct glucose_sample *glucose_history_get(uint8_t index);
+
+//Refills the history ring after a warm restart, oldest sample first; the next
+//sample gets the sequence number after `sequence` and the uptime continues from `uptime`
+void glucose_history_restore(const struct glucose_sample *samples, uint8_t count,
+                             uint32_t sequence, uint32_t uptime);
+
+//Node uptime in seconds, continued across warm restarts
+uint32_t glucose_uptime(void);
+
 #endif // GLOBAL_VARIABLES_H
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include "contiki.h"
+#include "sys/rtimer.h"
+#include "sys/log.h"
+#include "global_variables.h"
+#include "glucose_model.h"
+
+/* Log configuration */
+#define LOG_MODULE "glucose-model"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+/* Bergman minimal model of a type 1 diabetic patient, with a gut compartment
+ * for the meals and the pumps of the node as inputs:
+ *   dG/dt = -(p1 + X) G + p1 Gb + kabs Q + glucagon
+ *   dX/dt = -p2 X + p3 (I - Ib)
+ *   dI/dt = -n (I - Ib) + insulin
+ *   dQ/dt = -kabs Q
+ * G is the plasma glucose (mg/dL), X the insulin action (1/min), I the plasma
+ * insulin (uU/mL) and Q the glucose of the meals still in the gut (mg/dL).
+ * Time is in minutes of patient time.
+ */
+#define MODEL_P1 0.01f         // glucose effectiveness (1/min)
+#define MODEL_GB 150.0f        // basal glucose without insulin pump (mg/dL)
+#define MODEL_P2 0.025f        // decay of the insulin action (1/min)
+#define MODEL_P3 0.000013f     // gain of the insulin action (mL/uU/min^2)
+#define MODEL_N 0.09f          // insulin clearance (1/min)
+#define MODEL_IB 10.0f         // basal insulin (uU/mL)
+#define MODEL_KABS 0.05f       // absorption rate of the meals (1/min)
+#define MODEL_INSULIN 2.0f     // insulin infused by the pump (uU/mL/min)
+#define MODEL_GLUCAGON 2.0f    // glucose released under glucagon (mg/dL/min)
+#define MODEL_STEP 0.5f        // integration step (min)
+#define MODEL_START (6 * 60)   // patient time at start (min after midnight)
+#define MINUTES_PER_DAY (24 * 60)
+
+//Range counted as time-in-range by the benchmark (mg/dL)
+#define RANGE_LOW 70
+#define RANGE_HIGH 180
+
+//Daily meals of the scenario, varied by the seeded generator
+struct meal {
+	uint16_t time;   // minutes after midnight
+	uint16_t load;   // glucose brought into the gut (mg/dL)
+};
+
+static const struct meal meals[] = {
+	{ 7 * 60, 80 },        // breakfast
+	{ 12 * 60 + 30, 100 }, // lunch
+	{ 16 * 60, 30 },       // snack
+	{ 19 * 60 + 30, 90 },  // dinner
+};
+#define MEALS_COUNT (sizeof(meals) / sizeof(meals[0]))
+
+//State of the patient
+static float glucose;     // G
+static float action;      // X
+static float insulin;     // I
+static float gut;         // Q
+static float minutes;     // patient time since the start
+static uint8_t next_meal;        // index of the next meal of the day
+static float next_meal_time;     // patient time of the next meal
+//Separate streams, so that the meals do not depend on the number of samples taken
+static uint32_t meal_rng;        // meal times and loads
+static uint32_t noise_rng;       // noise of the sensor readings
+
+#if GLUCOSE_BENCHMARK
+//Metrics of the benchmark scenario
+static float minutes_in_range;
+static uint16_t actuations;
+static rtimer_clock_t sample_time;     // when the sample being processed was taken
+static bool control_pending;           // the controller changed the actuators on that sample
+static uint32_t latency_ticks_sum;
+static rtimer_clock_t latency_ticks_max;
+static bool reported;
+#endif
+
+
+/* xorshift32 generator: the model does not share random_rand() with the
+ * network stack, so its sequence only depends on the seed.
+ */
+static uint32_t model_random(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+
+//Returns a random integer between -range and range from the stream `state`
+static int model_jitter(uint32_t *state, int range) {
+	return (int)(model_random(state) % (2 * range + 1)) - range;
+}
+
+
+//Schedules the next meal of the scenario, up to 30 minutes early or late
+static void schedule_meal() {
+	float day = minutes + MODEL_START - (float)(((uint32_t)(minutes + MODEL_START)) % MINUTES_PER_DAY);
+
+	if(next_meal == MEALS_COUNT) {
+		next_meal = 0;
+		day += MINUTES_PER_DAY;
+	}
+	next_meal_time = day + meals[next_meal].time + model_jitter(&meal_rng, 30) - MODEL_START;
+}
+
+
+void glucose_model_init(uint32_t seed) {
+	meal_rng = seed != 0 ? seed : 1;
+	// Any other non-zero state, so that the two streams differ
+	noise_rng = (seed ^ 0x9e3779b9) != 0 ? seed ^ 0x9e3779b9 : 1;
+	glucose = MODEL_GB;
+	action = 0;
+	insulin = MODEL_IB;
+	gut = 0;
+	minutes = 0;
+	next_meal = 0;
+	schedule_meal();
+}
+
+
+/** Advances the patient by `seconds` of node time, that is seconds * GLUCOSE_MODEL_TIME_SCALE
+ * seconds of patient time, with the pumps in the state of insulin_activate and
+ * glucagon_activate. Meals are added to the gut when their time comes, with a
+ * load varied by up to 25%. The sensor reading adds up to 2 mg/dL of noise.
+ */
+int glucose_model_update(uint32_t seconds) {
+	float end = minutes + (float)seconds * GLUCOSE_MODEL_TIME_SCALE / 60;
+	float pump_insulin = insulin_activate ? MODEL_INSULIN : 0;
+	float pump_glucagon = glucagon_activate ? MODEL_GLUCAGON : 0;
+	int level;
+
+	while(minutes < end) {
+		float step = MIN(MODEL_STEP, end - minutes);
+		float dg, dx, di;
+
+		if(minutes >= next_meal_time) {
+			gut += meals[next_meal].load * (100 + model_jitter(&meal_rng, 25)) / 100.0f;
+			next_meal++;
+			schedule_meal();
+		}
+
+		dg = -(MODEL_P1 + action) * glucose + MODEL_P1 * MODEL_GB + MODEL_KABS * gut + pump_glucagon;
+		dx = -MODEL_P2 * action + MODEL_P3 * (insulin - MODEL_IB);
+		di = -MODEL_N * (insulin - MODEL_IB) + pump_insulin;
+		glucose += dg * step;
+		action += dx * step;
+		insulin += di * step;
+		gut -= MODEL_KABS * gut * step;
+		if(glucose < 20) {
+			glucose = 20;
+		}
+
+#if GLUCOSE_BENCHMARK
+		if(glucose >= RANGE_LOW && glucose <= RANGE_HIGH) {
+			minutes_in_range += step;
+		}
+#endif
+		minutes += step;
+	}
+
+	level = (int)(glucose + 0.5f) + model_jitter(&noise_rng, 2);
+
+#if GLUCOSE_BENCHMARK
+	sample_time = RTIMER_NOW();
+	if(!reported && minutes >= GLUCOSE_BENCHMARK_HOURS * 60) {
+		reported = true;
+		LOG_INFO("Benchmark over %u h (seed %lu): time in range %u%%, actuations %u, control latency avg %lu us max %lu us\n",
+		         GLUCOSE_BENCHMARK_HOURS, (unsigned long)GLUCOSE_MODEL_SEED,
+		         (unsigned)(minutes_in_range * 100 / minutes), actuations,
+		         actuations > 0 ? (unsigned long)((uint64_t)latency_ticks_sum * 1000000 / RTIMER_SECOND / actuations) : 0UL,
+		         (unsigned long)((uint64_t)latency_ticks_max * 1000000 / RTIMER_SECOND));
+	}
+#endif
+
+	return level;
+}
+
+
+#if GLUCOSE_BENCHMARK
+void glucose_benchmark_control(void) {
+	control_pending = true;
+}
+
+
+/** Accounts the latency from the sample to the actuators changed by the
+ * controller on it. Changes requested over CoAP are not counted.
+ */
+void glucose_benchmark_actuated(void) {
+	rtimer_clock_t latency;
+
+	if(!control_pending || reported) {
+		return;
+	}
+	control_pending = false;
+	latency = RTIMER_CLOCK_DIFF(RTIMER_NOW(), sample_time);
+	actuations++;
+	latency_ticks_sum += latency;
+	latency_ticks_max = MAX(latency_ticks_max, latency);
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef GLUCOSE_MODEL_H
+#define GLUCOSE_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Seed of the patient model, the same seed always gives the same meals and sensor noise
+#ifndef GLUCOSE_MODEL_SEED
+#define GLUCOSE_MODEL_SEED PATIENT_ID
+#endif
+
+//Benchmark mode: reports time-in-range, actuations and control-loop latency
+//once the scripted scenario is over
+#ifndef GLUCOSE_BENCHMARK
+#define GLUCOSE_BENCHMARK 0
+#endif
+
+//Length of the benchmark scenario in hours of patient time
+#ifndef GLUCOSE_BENCHMARK_HOURS
+#define GLUCOSE_BENCHMARK_HOURS 24
+#endif
+
+//Seconds of patient time simulated for every second of node time,
+//the benchmark runs its day in 12 minutes
+#ifndef GLUCOSE_MODEL_TIME_SCALE
+#if GLUCOSE_BENCHMARK
+#define GLUCOSE_MODEL_TIME_SCALE 120
+#else
+#define GLUCOSE_MODEL_TIME_SCALE 12
+#endif
+#endif
+
+//Resets the patient to the fasting state at 6:00 with the given seed
+void glucose_model_init(uint32_t seed);
+
+//Advances the patient by `seconds` of node time under the current insulin and
+//glucagon pumps and returns the glucose level read by the sensor (mg/dL)
+int glucose_model_update(uint32_t seconds);
+
+#if GLUCOSE_BENCHMARK
+//Marks that the controller changed the actuators on the sample being processed
+void glucose_benchmark_control(void);
+
+//Called by the actuator process when it applies a change of the actuators
+void glucose_benchmark_actuated(void);
+#endif
+
+#endif /* GLUCOSE_MODEL_H */
@@ -5,7 +5,6 @@
 #include "coap-engine.h"
 #include "sys/etimer.h"
 #include "os/dev/leds.h"
-#include "coap-blocking-api.h"
 #include "os/dev/button-hal.h"
 #include "node-id.h"
 #include "net/ipv6/simple-udp.h"
@@ -14,6 +13,22 @@
 #include "net/ipv6/uip-debug.h"
 #include "routing/routing.h"
 #include "global_variables.h"
+#include "actuators.h"
+#include "energy_stats.h"
+#include "coap_stats.h"
+#include "glucose_model.h"
+#include "registration.h"
+#include "connectivity.h"
+#include "traffic_class.h"
+#if WITH_PERSISTENCE
+#include "persistence.h"
+#endif
+#if WITH_MULTICAST
+#include "multicast_group.h"
+#endif
+#if WITH_OSCORE
+#include "glucose_oscore.h"
+#endif
 #include "sys/log.h"
 
 //Global variables to manage the state of the actuators and glucose level
@@ -22,43 +37,43 @@ bool insulin_activate = false;
 bool glucagon_activate = false;
 int glucose_level =90;
 
-// Definition of server endpoint and resource type
-#define SERVER_EP "coap://[fd00::1]:5683"
-#define RESOURCE_TYPE "Glucose_monitoring"
+//Thresholds and activation of the edge controller, set with glucose_control/config
+struct glucose_thresholds glucose_thresholds = { 180, 120, 70, 50 };
+bool edge_control_enabled = true;
+
+//Adaptive sampling bounds, set with glucose_control/sampling, and current interval
+struct sampling_config sampling_config = { 5, 60, 2, 20 };
+uint16_t sampling_interval = 5;
+
+//Ring of the last GLUCOSE_HISTORY_SIZE samples, served by the glucose/history resource
+static struct glucose_sample glucose_history[GLUCOSE_HISTORY_SIZE];
+static uint8_t glucose_history_next = 0;  // slot where the next sample is written
+static uint32_t glucose_sequence = 0;  // sequence number of the last sample
+uint8_t glucose_history_count = 0;
+//Uptime reached by the previous run, restored with its samples
+static uint32_t uptime_offset = 0;
 
 // Log configuration
 #define LOG_MODULE "glucose-monitoring"
 #define LOG_LEVEL LOG_LEVEL_APP
 
-//Simulation interval between sensor measurements
-#define SIMULATION_INTERVAL 5
-//Interval for registration retries with the observing collector
-#define REGISTRATION_INTERVAL 2
-//Interval for connection retries with the border router
-#define CONNECTION_TEST_INTERVAL 2
+//Number of samples in the rolling average driving the glucose controller
+#define AVERAGE_WINDOW 10
 
-//Coap Resources for the Glucose monitor: sensor (glucose_level) and actuators (insulin pump, glucagon pump and menrgency alert) 
+//Coap Resources for the Glucose monitor: sensor (glucose_level) and actuator states,
+//the resources of the single actuators (insulin pump, glucagon pump and menrgency alert) come from the actuator table
 extern coap_resource_t res_glucose_sensor;
-extern coap_resource_t res_insulin_control;
-extern coap_resource_t res_glucagon_control;
-extern coap_resource_t res_alert_control;
-
-
-//URL for registration 
-char *service_url = "/registration";
-
-//Registration status
-static bool registered = false;
+extern coap_resource_t res_glucose_history;
+extern coap_resource_t res_state_control;
+extern coap_resource_t res_config_control;
+extern coap_resource_t res_sampling_config;
+extern coap_resource_t res_energy_stats;
+extern coap_resource_t res_coap_stats;
 
 
 // Timer variables for various operations
 static struct etimer simulation_timer;  //Timer for simulations of sensor measurements
-static struct etimer connectivity_timer;  //Timer for connection retries with the border router
-static struct etimer registration_timer;  // Timer for registration retries
 static struct etimer registration_led_timer;  // Timer for LED blinking during registration
-static struct etimer actuating_led_timer;  // Timer for actuating LEDs
-static struct etimer led_on_timer;  // Timer for turning LEDs on
-static struct etimer blink_timer;  // General timer for blinking
 
 
 /*-----------------------------------------------------------------------*/
@@ -73,82 +88,144 @@ PROCESS(sensor_simulating, "sensor_simulating");
 AUTOSTART_PROCESSES(&glucose_monitoring_server, &actuator_simulation, &sensor_simulating);
 
 
-/**Checks connectivity with the border router
- * This function checks if the node can reach the border router. If the
- * router is reachable, it prints "The Border Router is reachable" message 
- * and returns true.
- * Otherwise, it prints a waiting message and returns false.
+/** Returns the node uptime in seconds, continued from the samples restored
+ * after a warm restart, so that the timestamps of the history stay ordered.
  */
-static bool is_connected() {
-	if(NETSTACK_ROUTING.node_is_reachable()) {
-		printf("The Border Router is reachable\n");
-		return true;
-  	} else {
-		printf("Waiting for connection with the Border Router\n");
-	}
-	return false;
+uint32_t glucose_uptime(void) {
+	return (uint32_t)clock_seconds() + uptime_offset;
 }
 
 
+/** Stores the current glucose level in the history ring.
+ * Each sample gets the next sequence number and the node uptime as timestamp.
+ * When the ring is full the oldest sample is overwritten.
+ */
+static void record_glucose_sample() {
+	struct glucose_sample *sample = &glucose_history[glucose_history_next];
+
+	sample->seq = ++glucose_sequence;
+	sample->timestamp = glucose_uptime();
+	sample->level = (int16_t)glucose_level;
+
+	glucose_history_next = (glucose_history_next + 1) % GLUCOSE_HISTORY_SIZE;
+	if(glucose_history_count < GLUCOSE_HISTORY_SIZE) {
+		glucose_history_count++;
+	}
+}
+
 
-/** Handler for connection requests sent by the collector.
- * If the recieved response is NULL, it indicates a timeout, 
- * and the function sets a timer for registration retries.
- * If the response contains "Success", the registrationf lag is set to true. 
- * Otherwise, it sets a timer for registration retries.
+/** Refills the history ring with samples saved before a restart, oldest first.
+ * The sequence numbers and the uptime continue from `sequence` and `uptime`,
+ * past those of the samples taken after the save and lost with the restart,
+ * so a sequence number or an ETag never names two different readings.
  */
-void client_chunk_handler(coap_message_t *response) {
-	const uint8_t *chunk;
-	// Check if the response is NULL (timeout)
-	if(response == NULL) {
-		printf("Request timed out\n");
-		etimer_set(&registration_timer, CLOCK_SECOND* REGISTRATION_INTERVAL);
+void glucose_history_restore(const struct glucose_sample *samples, uint8_t count,
+                             uint32_t sequence, uint32_t uptime) {
+	glucose_sequence = sequence;
+	uptime_offset = uptime - (uint32_t)clock_seconds();
+	count = MIN(count, GLUCOSE_HISTORY_SIZE);
+	if(count == 0) {
 		return;
 	}
+	memcpy(glucose_history, samples, count * sizeof(*samples));
+	glucose_history_count = count;
+	glucose_history_next = count % GLUCOSE_HISTORY_SIZE;
+	glucose_level = samples[count - 1].level;
+}
 
-	// Get the payload from the response
-	int len = coap_get_payload(response, &chunk);
-	
 
-	// Check if the payload contains "Success"
-	if(strncmp((char*)chunk, "Success", len) == 0){
-		registered = true;
-	} else
-		// Registration failed, retry after 2 SECONDS delay
-		etimer_set(&registration_timer, CLOCK_SECOND* REGISTRATION_INTERVAL);
+/** Returns the i-th oldest sample of the history ring, or NULL if the
+ * index is beyond the number of stored samples.
+ */
+const struct glucose_sample *glucose_history_get(uint8_t index) {
+	if(index >= glucose_history_count) {
+		return NULL;
+	}
+	return &glucose_history[(glucose_history_next + GLUCOSE_HISTORY_SIZE - glucose_history_count + index) % GLUCOSE_HISTORY_SIZE];
 }
 
 
-
-/**Simulates a blood glucose level reading.
- * This function generates random blood glucose levels within a broader range 
- * from 50 to 250 mg/dL to mimic real-world variations.
+/** Chooses the interval until the next sample from the glucose trend.
+ * The node samples at the minimum interval while the level changes faster than
+ * the configured rate or is within the margin of a controller threshold; while
+ * glucose is stable and in range the interval doubles at every sample up to the
+ * maximum. Speeding up is immediate, slowing down is gradual.
  */
-static int simulate_blood_glucose_level() {
+static void adapt_sampling_interval() {
+	const struct glucose_sample *last = glucose_history_get(glucose_history_count - 1);
+	const struct glucose_sample *previous = glucose_history_get(glucose_history_count - 2);
+	int32_t distance;
+	bool urgent = false;
+
+	// Rate of change in mg/dL per minute between the last two samples
+	if(last != NULL && previous != NULL && last->timestamp > previous->timestamp) {
+		int32_t rate = (int32_t)(last->level - previous->level) * 60 / (int32_t)(last->timestamp - previous->timestamp);
+		urgent = abs(rate) >= sampling_config.rate;
+	}
 
-   // Generate a random glucose level between 50 and 250 mg/dL
-    return (int)(rand() % (250 - 50 + 1) + 50); 
-} 
+	// Distance from the nearest band edge of the controller
+	distance = MIN(abs(glucose_level - glucose_thresholds.insulin), abs(glucose_level - glucose_thresholds.glucagon));
+	if(distance <= sampling_config.margin || glucose_level > glucose_thresholds.insulin ||
+	   glucose_level <= glucose_thresholds.glucagon) {
+		urgent = true;
+	}
 
+	if(urgent) {
+		sampling_interval = sampling_config.min_interval;
+	} else {
+		sampling_interval = MIN(sampling_interval * 2, sampling_config.max_interval);
+	}
+	sampling_interval = MAX(sampling_interval, sampling_config.min_interval);
+}
 
 
-/** Updates the simulated glucose level based on the active actuators.
- * when insulin is activated glucose level decreases by 10
- * when glucagon is activated glucose level increases by 10 
- * unless generate random glucose levels
+/** Wakes up the sensor process to apply a new sampling configuration. */
+void sampling_config_changed(void) {
+	process_poll(&sensor_simulating);
+}
+
+
+/** Drives the actuators from the rolling average of the last AVERAGE_WINDOW samples.
+ * It applies the same bands used by the cloud application:
+ *  - above alert_high: insulin and alert
+ *  - above insulin: insulin
+ *  - above glucagon: normal state, every actuator off
+ *  - above alert_low: glucagon
+ *  - otherwise: glucagon and alert
+ * The sum of the window is compared with the thresholds scaled by the number
+ * of samples, so no precision is lost in the division.
+ * The actuator process and the observers of glucose_control/state are
+ * notified when the state changes.
  */
-static void update_glucose_level() {
-    if (insulin_activate) 
-    {
-        glucose_level -= 10;
-     
-    } else if (glucagon_activate) 
-    {
-        glucose_level += 10;
-    } 
-    else {
-        glucose_level = simulate_blood_glucose_level();
-    }
+static void control_glucose_level() {
+	uint8_t samples = MIN(glucose_history_count, AVERAGE_WINDOW);
+	int32_t sum = 0;
+	bool insulin, glucagon, alert;
+	uint8_t i;
+
+	if(samples == 0) {
+		return;
+	}
+	for(i = glucose_history_count - samples; i < glucose_history_count; i++) {
+		sum += glucose_history_get(i)->level;
+	}
+
+	insulin = sum > (int32_t)glucose_thresholds.insulin * samples;
+	glucagon = sum <= (int32_t)glucose_thresholds.glucagon * samples;
+	alert = sum > (int32_t)glucose_thresholds.alert_high * samples ||
+	        sum <= (int32_t)glucose_thresholds.alert_low * samples;
+
+	if(insulin != insulin_activate || glucagon != glucagon_activate || alert != alert_activate) {
+		insulin_activate = insulin;
+		glucagon_activate = glucagon;
+		alert_activate = alert;
+		LOG_INFO("Average glucose %ld: insulin %s, glucagon %s, alert %s\n", (long)(sum / samples),
+		         insulin ? "ON" : "OFF", glucagon ? "ON" : "OFF", alert ? "ON" : "OFF");
+#if GLUCOSE_BENCHMARK
+		glucose_benchmark_control();
+#endif
+		actuators_changed();
+	}
 }
 
 
@@ -156,43 +233,60 @@ static void update_glucose_level() {
 PROCESS_THREAD(glucose_monitoring_server, ev, data){
 	PROCESS_BEGIN();
 
-	static coap_endpoint_t server_ep;
-        static coap_message_t request[1];
+	// The CPU time of the process is accounted between each wake-up and the following wait
+	energy_stats_begin(STATS_PROCESS_SERVER);
 
 	//Activate CoAP resources
 	printf("Starting CoAP server\n");
 	coap_activate_resource(&res_glucose_sensor, "glucose/level"); 
-	coap_activate_resource(&res_insulin_control, "glucose_control/insulin");
-	coap_activate_resource(&res_glucagon_control, "glucose_control/glucagon");
-	coap_activate_resource(&res_alert_control, "glucose_control/alert");
-
-
-	// try to connect to the border router
-	etimer_set(&connectivity_timer, CLOCK_SECOND * CONNECTION_TEST_INTERVAL);
-	PROCESS_WAIT_UNTIL(etimer_expired(&connectivity_timer));
-	while(!is_connected()) {
-		etimer_reset(&connectivity_timer);
-		PROCESS_WAIT_UNTIL(etimer_expired(&connectivity_timer));
+	coap_activate_resource(&res_glucose_history, "glucose/history");
+	actuators_init();
+#if WITH_MULTICAST
+	// The actuators also take the non-confirmable PUTs sent to the whole ward
+	multicast_group_join();
+#endif
+	coap_activate_resource(&res_state_control, "glucose_control/state");
+	coap_activate_resource(&res_config_control, "glucose_control/config");
+	coap_activate_resource(&res_sampling_config, "glucose_control/sampling");
+	coap_activate_resource(&res_energy_stats, "stats/energy");
+	coap_activate_resource(&res_coap_stats, "stats/coap");
+	coap_stats_init();
+	// Alert traffic of the node and of the nodes it forwards for
+	traffic_class_init();
+#if WITH_PERSISTENCE
+	// Take over the configuration, samples and registrations of the last run,
+	// before the sensor process takes its first sample
+	persistence_restore();
+#endif
+#if WITH_OSCORE
+	// Continues from the OSCORE sequence number restored above
+	glucose_oscore_init();
+#endif
+
+
+	// Wait for the node to join the DODAG: the connectivity manager wakes the
+	// process as soon as the border router is reachable
+	connectivity_subscribe();
+	while(!connectivity_is_up()) {
+		printf("Waiting for connection with the Border Router\n");
+		energy_stats_end(STATS_PROCESS_SERVER);
+		PROCESS_WAIT_EVENT_UNTIL(ev == connectivity_event);
+		energy_stats_begin(STATS_PROCESS_SERVER);
+	}
+	printf("The Border Router is reachable\n");
+
+	// Register with all the collectors in parallel: the answers come back
+	// through the CoAP callbacks, so the process never blocks on one collector
+	registration_start();
+	while(1) {
+		energy_stats_end(STATS_PROCESS_SERVER);
+		PROCESS_WAIT_EVENT();
+		energy_stats_begin(STATS_PROCESS_SERVER);
+		if(ev == connectivity_event && connectivity_is_up()) {
+			registration_network_up();
+		}
+		registration_handle_event(ev, data);
 	}
-
-	//try to connect to the collector
-	while(!registered) {
-    	printf("Sending registration message\n");
-    	
-    	// Parse the server endpoint string (SERVER_EP) and store the parsed 
-        // endpoint information in the server_ep variable
-    	coap_endpoint_parse(SERVER_EP, strlen(SERVER_EP), &server_ep);
-    	
-    	// Prepare the message
-    	coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
-    	coap_set_header_uri_path(request, service_url);
-    	coap_set_payload(request, (uint8_t *)RESOURCE_TYPE, sizeof(RESOURCE_TYPE) - 1);
-
-    	// Send the registration request and wait for a response
-    	COAP_BLOCKING_REQUEST(&server_ep, request, client_chunk_handler);
-
-    	PROCESS_WAIT_UNTIL(etimer_expired(&registration_timer));
-    }
 
 	PROCESS_END();
 }
@@ -205,15 +299,14 @@ PROCESS_THREAD(actuator_simulation, ev, data)
 {
     
 	PROCESS_BEGIN();
-	// Initialize the timer to blink every second
-	etimer_set(&blink_timer, CLOCK_SECOND);
 	
         // Set a timer for controlling the yellow LED blinking during registration.
 	etimer_set(&registration_led_timer, 1*CLOCK_SECOND);
 
 	//yellow led blinking until the connection to the border router and the collector is not complete
 	
-	while(!is_connected()){
+	connectivity_subscribe();
+	while(!connectivity_is_up()){
 		PROCESS_YIELD();
 		if (ev == PROCESS_EVENT_TIMER){
 			if(etimer_expired(&registration_led_timer)){
@@ -225,15 +318,17 @@ PROCESS_THREAD(actuator_simulation, ev, data)
 	}
 	// Indicate successful connection
 	printf("Connected\n");
-	etimer_set(&actuating_led_timer, 5*CLOCK_SECOND);
-	etimer_set(&led_on_timer, 1*CLOCK_SECOND);
 	
 	// Turn off the yellow LED after the connection is established.
 	leds_single_off(LEDS_YELLOW);
 
-  // Main loop for LED actuation 
-   while (1) {
-    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&blink_timer));
+  // Main loop for LED actuation: the LEDs are updated as soon as an actuator
+  // changes, the first pass shows the state reached during the connection
+  while (1) {
+    energy_stats_begin(STATS_PROCESS_ACTUATOR);
+#if GLUCOSE_BENCHMARK
+    glucose_benchmark_actuated();
+#endif
 
     // Emergency Alert (Red LED)
     if (alert_activate) {
@@ -256,8 +351,9 @@ PROCESS_THREAD(actuator_simulation, ev, data)
         leds_on(LEDS_GREEN);
     }
 
-    // Reset the blink timer
-    etimer_reset(&blink_timer);
+    // Wait for the next change of the actuator states
+    energy_stats_end(STATS_PROCESS_ACTUATOR);
+    PROCESS_WAIT_EVENT_UNTIL(ev == actuator_event);
 }
 	PROCESS_END();
 }
@@ -272,18 +368,54 @@ PROCESS_THREAD(sensor_simulating, ev, data)
 {
 	PROCESS_BEGIN();
 	
+    static clock_time_t last_sample;  // node time of the last model update
+    static uint32_t elapsed;
+
+    // Start the patient model, the seed makes every run reproducible; after a
+    // warm restart the last saved sample is served until the next one
+    glucose_model_init(GLUCOSE_MODEL_SEED);
+    if(glucose_history_count == 0) {
+        glucose_level = glucose_model_update(0);
+    }
+    last_sample = clock_time();
+
     //Set up a timer for glucose level simulation
-    etimer_set(&simulation_timer, CLOCK_SECOND * SIMULATION_INTERVAL);
+    etimer_set(&simulation_timer, CLOCK_SECOND * sampling_interval);
 
         while (1) {
-        // Wait until the simulation timer expires
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&simulation_timer));
-
-        // Update glucose level 
-        update_glucose_level();
-
-        // Reset the simulation timer
-        etimer_reset(&simulation_timer);
+        // Wait until the simulation timer expires, or a new sampling configuration
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&simulation_timer) || ev == PROCESS_EVENT_POLL);
+        energy_stats_begin(STATS_PROCESS_SENSOR);
+
+        if(ev == PROCESS_EVENT_POLL) {
+            // Keep the current interval inside the new bounds, counting from now
+            sampling_interval = MAX(MIN(sampling_interval, sampling_config.max_interval), sampling_config.min_interval);
+            etimer_set(&simulation_timer, CLOCK_SECOND * sampling_interval);
+            energy_stats_end(STATS_PROCESS_SENSOR);
+            continue;
+        }
+
+        // Advance the patient model to now, in whole seconds of node time
+        elapsed = (clock_time() - last_sample + CLOCK_SECOND / 2) / CLOCK_SECOND;
+        last_sample += elapsed * CLOCK_SECOND;
+        glucose_level = glucose_model_update(elapsed);
+        record_glucose_sample();
+#if WITH_PERSISTENCE
+        persistence_sample_recorded();
+#endif
+
+        // Drive the actuators locally from the rolling average
+        if(edge_control_enabled) {
+            control_glucose_level();
+        }
+
+        // Notify the observers of the glucose resource about the new sample
+        res_glucose_sensor.trigger();
+
+        // Schedule the next sample according to the glucose trend
+        adapt_sampling_interval();
+        etimer_set(&simulation_timer, CLOCK_SECOND * sampling_interval);
+        energy_stats_end(STATS_PROCESS_SENSOR);
     }
 	
 	PROCESS_END();
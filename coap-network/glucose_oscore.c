@@ -0,0 +1,86 @@
+#include "contiki.h"
+#include "coap-engine.h"
+#include "oscore.h"
+#include "sys/log.h"
+#include "actuators.h"
+#include "persistence.h"
+#include "glucose_oscore.h"
+
+/* Log configuration */
+#define LOG_MODULE "glucose-oscore"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+#if !WITH_PERSISTENCE
+#error "OSCORE needs the persistent state to keep its sender sequence number across restarts"
+#endif
+
+//AES-CCM-16-64-128, the default algorithm of OSCORE
+#define OSCORE_ALGORITHM 10
+
+//Resources answering only OSCORE-protected requests, besides the actuators
+extern coap_resource_t res_glucose_sensor;
+extern coap_resource_t res_state_control;
+extern coap_resource_t res_config_control;
+extern coap_resource_t res_sampling_config;
+
+static const uint8_t master_secret[] = GLUCOSE_OSCORE_MASTER_SECRET;
+static const uint8_t salt[] = GLUCOSE_OSCORE_SALT;
+static const uint8_t sender_id[] = GLUCOSE_OSCORE_SENDER_ID;
+static const uint8_t recipient_id[] = GLUCOSE_OSCORE_RECIPIENT_ID;
+
+//Security context with the collector, including its replay window
+static oscore_ctx_t context;
+//Sender sequence numbers below this one are reserved in flash
+static uint64_t ssn_limit;
+
+
+/* Saves a new high-water mark of the sender sequence number, a window ahead
+ * of the current one. After a restart the node starts from the saved mark, so
+ * it never reuses a sequence number, which would reuse an AES-CCM nonce under
+ * the same key.
+ */
+static void reserve_ssn(void) {
+	uint64_t limit = context.sender_context.seq + GLUCOSE_OSCORE_SSN_WINDOW;
+
+	if(!persistence_save_oscore_ssn(limit)) {
+		LOG_ERR("Cannot reserve the OSCORE sequence numbers up to %lu\n", (unsigned long)limit);
+		return;
+	}
+	ssn_limit = limit;
+}
+
+
+/** Derives the context shared with the collector and protects the resources.
+ * The keys come from the pre-provisioned secret, so no handshake is needed:
+ * a request is accepted as soon as it decrypts and passes the replay window.
+ * glucose/history and stats/energy stay plain CoAP, they are read-only and served
+ * with Block2.
+ */
+void glucose_oscore_init(void) {
+	size_t i;
+
+	oscore_init_server();
+	oscore_derive_ctx(&context, (uint8_t *)master_secret, sizeof(master_secret),
+	                  (uint8_t *)salt, sizeof(salt), OSCORE_ALGORITHM,
+	                  (uint8_t *)sender_id, sizeof(sender_id),
+	                  (uint8_t *)recipient_id, sizeof(recipient_id), NULL, 0);
+	// Nothing at or above the mark saved before the restart was used
+	context.sender_context.seq = persistence_oscore_ssn();
+	reserve_ssn();
+
+	oscore_protect_resource(&res_glucose_sensor);
+	oscore_protect_resource(&res_state_control);
+	oscore_protect_resource(&res_config_control);
+	oscore_protect_resource(&res_sampling_config);
+	for(i = 0; i < actuators_count(); i++) {
+		oscore_protect_resource(&actuators_get(i)->resource);
+	}
+	LOG_INFO("OSCORE protection enabled, sequence number %lu\n", (unsigned long)context.sender_context.seq);
+}
+
+
+void glucose_oscore_sent(void) {
+	if(context.sender_context.seq + GLUCOSE_OSCORE_SSN_WINDOW / 2 >= ssn_limit) {
+		reserve_ssn();
+	}
+}
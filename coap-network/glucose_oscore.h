@@ -0,0 +1,40 @@
+#ifndef GLUCOSE_OSCORE_H
+#define GLUCOSE_OSCORE_H
+
+/* Pre-provisioned OSCORE security context shared with the collector.
+ * There is no default master secret: every node must be built with its own, e.g.
+ *   make MAKE_WITH_OSCORE=1 CFLAGS+='-DGLUCOSE_OSCORE_CONF_MASTER_SECRET="{ 0x.., ... }"'
+ * and the collector keeps the same context in Cloud_App/oscore/<node address>/.
+ */
+#ifdef GLUCOSE_OSCORE_CONF_MASTER_SECRET
+#define GLUCOSE_OSCORE_MASTER_SECRET GLUCOSE_OSCORE_CONF_MASTER_SECRET
+#else
+#error "OSCORE needs the master secret of the node in GLUCOSE_OSCORE_CONF_MASTER_SECRET"
+#endif
+
+#ifdef GLUCOSE_OSCORE_CONF_SALT
+#define GLUCOSE_OSCORE_SALT GLUCOSE_OSCORE_CONF_SALT
+#else
+#define GLUCOSE_OSCORE_SALT { 0x9e, 0x7c, 0xa9, 0x22, 0x23, 0x78, 0x63, 0x40 }
+#endif
+
+//Sender ID of the node and of the collector
+#define GLUCOSE_OSCORE_SENDER_ID { 0x01 }
+#define GLUCOSE_OSCORE_RECIPIENT_ID { 0x00 }
+
+//Sender sequence numbers reserved in flash at a time: a new block is reserved
+//once half of the current one is used
+#ifdef GLUCOSE_OSCORE_CONF_SSN_WINDOW
+#define GLUCOSE_OSCORE_SSN_WINDOW GLUCOSE_OSCORE_CONF_SSN_WINDOW
+#else
+#define GLUCOSE_OSCORE_SSN_WINDOW 256
+#endif
+
+//Derives the security context and protects glucose/level and the glucose_control/* resources;
+//called after persistence_restore(), which gives the sender sequence number to start from
+void glucose_oscore_init(void);
+
+//Called for every message sent: reserves the next block of sender sequence numbers in time
+void glucose_oscore_sent(void);
+
+#endif /* GLUCOSE_OSCORE_H */
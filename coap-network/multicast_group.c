@@ -0,0 +1,56 @@
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-separate.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "sys/log.h"
+#include "glucose_group.h"
+#include "multicast_group.h"
+
+/* Log configuration */
+#define LOG_MODULE "multicast-group"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Never resumed: it only takes the group requests away from the engine
+static coap_separate_t no_response;
+
+
+void multicast_group_join(void) {
+	uip_ipaddr_t group;
+
+	GLUCOSE_GROUP_ADDRESS(&group);
+	if(uip_ds6_maddr_add(&group) == NULL) {
+		LOG_ERR("Cannot join the multicast group\n");
+		return;
+	}
+	LOG_INFO("Joined the multicast group ");
+	LOG_INFO_6ADDR(&group);
+	LOG_INFO_("\n");
+}
+
+
+/** The CoAP engine handles the request while the packet is still in the uIP
+ * buffer, so its destination tells a group request from a unicast one.
+ */
+bool multicast_group_request(void) {
+	return uip_is_addr_mcast(&UIP_IP_BUF->destipaddr);
+}
+
+
+/** Takes the request over as a separate response that is never sent: the
+ * engine then sends nothing, instead of one answer per node of the group
+ * converging on the collector (RFC 7252, 8.2).
+ * coap_separate_accept() sends an empty ACK for a confirmable request, so a
+ * confirmable request, which is not valid for a group (RFC 7252, 8.1), is
+ * taken over as non-confirmable: every member ignores it without any ACK.
+ * Returns false for such a request, which must not be processed.
+ */
+bool multicast_group_no_response(coap_message_t *request) {
+	bool confirmable = request->type == COAP_TYPE_CON;
+
+	if(confirmable) {
+		request->type = COAP_TYPE_NON;
+	}
+	coap_separate_accept(request, &no_response);
+	return !confirmable;
+}
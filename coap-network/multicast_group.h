@@ -0,0 +1,17 @@
+#ifndef MULTICAST_GROUP_H
+#define MULTICAST_GROUP_H
+
+#include <stdbool.h>
+#include "coap-engine.h"
+
+//Joins the multicast group of the glucose nodes (see glucose_group.h)
+void multicast_group_join(void);
+
+//True if the request being handled was sent to a multicast group
+bool multicast_group_request(void);
+
+//Sends no response nor ACK to the request being handled, as a group request expects;
+//returns false if the request is confirmable and must be ignored
+bool multicast_group_no_response(coap_message_t *request);
+
+#endif /* MULTICAST_GROUP_H */
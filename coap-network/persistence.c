@@ -0,0 +1,220 @@
+#include <stddef.h>
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "lib/crc16.h"
+#include "sys/log.h"
+#include "global_variables.h"
+#include "registration.h"
+#include "persistence.h"
+
+/* Log configuration */
+#define LOG_MODULE "persistence"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Files holding the two slots of the state, see struct persistent_record
+static const char *slot_files[2] = { "glucose.state0", "glucose.state1" };
+//Identifies the record layout: change it whenever struct persistent_state changes
+#define PERSISTENCE_MAGIC 0x6703
+
+//State saved to flash
+struct persistent_state {
+	uint32_t generation;                      // incremented at every save, the newest valid slot wins
+	uint32_t sequence;                        // sequence number of the last sample at the save
+	uint32_t uptime;                          // glucose_uptime() at the save
+	uint64_t oscore_ssn;                      // OSCORE sender sequence numbers below are reserved
+	struct glucose_thresholds thresholds;
+	struct sampling_config sampling;
+	struct registration_snapshot registration;
+	uint8_t edge_control_enabled;
+	uint8_t sample_count;
+	struct glucose_sample samples[PERSISTENCE_SAMPLES];  // oldest first
+};
+
+/* The state has two slots, written in turn, so that a reset in the middle of a
+ * write always leaves the previous state intact and the writes are spread over
+ * twice the flash.
+ * Each slot has its own file, as opening a file for writing truncates it on
+ * some backends (cfs-posix, without CFS_APPEND, which in turn makes every
+ * write go to the end). Some other backends (cfs-cooja) hold a single file
+ * whatever the name: each slot also stays at its own offset in its file.
+ */
+struct persistent_record {
+	uint16_t magic;
+	uint16_t crc;  // of the state
+	struct persistent_state state;
+};
+
+static struct persistent_record record;
+//Generation of the last state written or restored
+static uint32_t generation = 0;
+//Checksum of the configuration and registrations last written, to skip unchanged writes
+static uint16_t settings_crc;
+//Sequence number of the newest sample last written
+static uint32_t saved_sequence = 0;
+//Uptime of the last write, to rate limit the writes of new samples
+static uint32_t saved_time = 0;
+//High-water mark of the OSCORE sender sequence number
+static uint64_t oscore_ssn = 0;
+
+
+//Checksum of the state apart from the generation and the samples
+static uint16_t settings_checksum(const struct persistent_state *state) {
+	return crc16_data((const unsigned char *)&state->thresholds,
+	                  offsetof(struct persistent_state, samples) - offsetof(struct persistent_state, thresholds), 0);
+}
+
+
+//Fills the state with the current configuration, registrations and last samples
+static void collect_state(struct persistent_state *state) {
+	uint8_t first;
+	uint8_t i;
+
+	// Zero the padding too, it is part of the checksums
+	memset(state, 0, sizeof(*state));
+	state->uptime = glucose_uptime();
+	state->oscore_ssn = oscore_ssn;
+	state->thresholds = glucose_thresholds;
+	state->sampling = sampling_config;
+	registration_snapshot(&state->registration);
+	state->edge_control_enabled = edge_control_enabled;
+	state->sample_count = MIN(glucose_history_count, PERSISTENCE_SAMPLES);
+	first = glucose_history_count - state->sample_count;
+	for(i = 0; i < state->sample_count; i++) {
+		state->samples[i] = *glucose_history_get(first + i);
+	}
+	state->sequence = state->sample_count > 0 ? state->samples[state->sample_count - 1].seq : 0;
+}
+
+
+//Writes the state in the slot after the one of the previous generation
+static bool write_state(void) {
+	uint8_t slot;
+	int fd;
+	int len;
+
+	record.magic = PERSISTENCE_MAGIC;
+	record.state.generation = generation + 1;
+	record.crc = crc16_data((const unsigned char *)&record.state, sizeof(record.state), 0);
+
+	slot = record.state.generation % 2;
+	fd = cfs_open(slot_files[slot], CFS_READ | CFS_WRITE);
+	if(fd < 0) {
+		LOG_WARN("Cannot open %s\n", slot_files[slot]);
+		return false;
+	}
+	len = -1;
+	if(cfs_seek(fd, slot * sizeof(record), CFS_SEEK_SET) >= 0) {
+		len = cfs_write(fd, &record, sizeof(record));
+	}
+	cfs_close(fd);
+	if(len != sizeof(record)) {
+		LOG_WARN("Cannot write %s\n", slot_files[slot]);
+		return false;
+	}
+
+	generation = record.state.generation;
+	settings_crc = settings_checksum(&record.state);
+	saved_sequence = record.state.sequence;
+	saved_time = record.state.uptime;
+	LOG_DBG("State %lu saved with %u samples\n", (unsigned long)generation, record.state.sample_count);
+	return true;
+}
+
+
+/** Reads both slots and keeps the valid one with the newest generation.
+ * Returns false if neither slot holds a state of this firmware.
+ */
+static bool read_state(struct persistent_state *state) {
+	bool found = false;
+	int fd;
+	int len;
+	uint8_t slot;
+
+	for(slot = 0; slot < 2; slot++) {
+		fd = cfs_open(slot_files[slot], CFS_READ);
+		if(fd < 0) {
+			continue;
+		}
+		len = -1;
+		if(cfs_seek(fd, slot * sizeof(record), CFS_SEEK_SET) >= 0) {
+			len = cfs_read(fd, &record, sizeof(record));
+		}
+		cfs_close(fd);
+		if(len != sizeof(record) ||
+		   record.magic != PERSISTENCE_MAGIC ||
+		   record.crc != crc16_data((const unsigned char *)&record.state, sizeof(record.state), 0) ||
+		   record.state.sample_count > PERSISTENCE_SAMPLES) {
+			continue;
+		}
+		if(!found || (int32_t)(record.state.generation - state->generation) > 0) {
+			*state = record.state;
+			found = true;
+		}
+	}
+	return found;
+}
+
+
+bool persistence_restore(void) {
+	struct persistent_state state;
+
+	if(!read_state(&state)) {
+		LOG_INFO("No saved state, cold start\n");
+		return false;
+	}
+
+	glucose_thresholds = state.thresholds;
+	sampling_config = state.sampling;
+	edge_control_enabled = state.edge_control_enabled;
+	oscore_ssn = state.oscore_ssn;
+	sampling_interval = sampling_config.min_interval;
+	// Skip the sequence numbers and the uptime of the samples taken after the save
+	glucose_history_restore(state.samples, state.sample_count,
+	                        state.sequence + PERSISTENCE_RESERVE, state.uptime + PERSISTENCE_RESERVE);
+	registration_restore(&state.registration);
+
+	generation = state.generation;
+	settings_crc = settings_checksum(&state);
+	saved_sequence = state.sequence;
+	saved_time = glucose_uptime();
+	LOG_INFO("Warm restart from state %lu with %u samples\n", (unsigned long)generation, state.sample_count);
+	return true;
+}
+
+
+/** Writes the state when the configuration or the registrations changed.
+ * The samples are saved along with it, but new samples alone never cause a
+ * write here: see persistence_sample_recorded().
+ */
+void persistence_save(void) {
+	collect_state(&record.state);
+	if(generation != 0 && settings_checksum(&record.state) == settings_crc) {
+		return;
+	}
+	write_state();
+}
+
+
+void persistence_sample_recorded(void) {
+	const struct glucose_sample *last = glucose_history_get(glucose_history_count - 1);
+
+	if(last == NULL || last->seq == saved_sequence ||
+	   glucose_uptime() - saved_time < PERSISTENCE_SAMPLE_INTERVAL) {
+		return;
+	}
+	collect_state(&record.state);
+	write_state();
+}
+
+
+uint64_t persistence_oscore_ssn(void) {
+	return oscore_ssn;
+}
+
+
+bool persistence_save_oscore_ssn(uint64_t limit) {
+	oscore_ssn = limit;
+	collect_state(&record.state);
+	return write_state();
+}
@@ -0,0 +1,43 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "global_variables.h"
+
+//Samples of the history ring saved to flash, enough to refill the rolling average
+#define PERSISTENCE_SAMPLES 16
+
+//Minimum interval between two saves triggered by new samples, in seconds:
+//samples are the only state changing continuously, so they set the flash wear
+#ifdef PERSISTENCE_CONF_SAMPLE_INTERVAL
+#define PERSISTENCE_SAMPLE_INTERVAL PERSISTENCE_CONF_SAMPLE_INTERVAL
+#else
+#define PERSISTENCE_SAMPLE_INTERVAL 300
+#endif
+
+//Sequence numbers and seconds of uptime skipped on a warm restart. The samples
+//taken since the last save are lost, and they are at most one per second over
+//PERSISTENCE_SAMPLE_INTERVAL: skipping them never reissues a sequence number
+//or a timestamp that a collector may already hold for another reading.
+#define PERSISTENCE_RESERVE (PERSISTENCE_SAMPLE_INTERVAL + 1)
+
+//Restores the saved configuration, samples and registrations;
+//returns true on a warm restart, that is when a valid state was found
+bool persistence_restore(void);
+
+//Saves the state to flash if it changed since the last save
+void persistence_save(void);
+
+//Called for every new sample: saves the state at most every PERSISTENCE_SAMPLE_INTERVAL
+void persistence_sample_recorded(void);
+
+//OSCORE sender sequence number to start from: the high-water mark saved before
+//the restart, 0 on a cold start
+uint64_t persistence_oscore_ssn(void);
+
+//Saves the state at once with a new high-water mark of the OSCORE sender
+//sequence number; returns false if it could not be written
+bool persistence_save_oscore_ssn(uint64_t limit);
+
+#endif /* PERSISTENCE_H */
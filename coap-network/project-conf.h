@@ -46,6 +46,22 @@
 #undef UIP_CONF_BUFFER_SIZE
 #define UIP_CONF_BUFFER_SIZE 240
 
+/* Default route notifications, which wake up the connectivity manager */
+#define UIP_CONF_DS6_ROUTE_NOTIFICATIONS 1
+
+/* MPL floods the commands sent to the multicast group of the nodes */
+#if WITH_MULTICAST
+#define UIP_MCAST6_CONF_ENGINE UIP_MCAST6_ENGINE_MPL
+#endif
+
+/* TSCH profile with the alert slotframe, built with MAKE_WITH_TSCH=1 */
+#if WITH_TSCH
+#include "tsch-profile.h"
+#endif
+
+/* Energest accounting, reported by the stats/energy resource */
+#define ENERGEST_CONF_ON 1
+
 #define LOG_LEVEL_APP LOG_LEVEL_DBG
 
 #endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-callback-api.h"
+#include "sys/etimer.h"
+#include "lib/random.h"
+#include "lib/crc16.h"
+#include "sys/log.h"
+#include "registration.h"
+#include "coap_stats.h"
+#if WITH_PERSISTENCE
+#include "persistence.h"
+#endif
+
+/* Log configuration */
+#define LOG_MODULE "registration"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//First interval for registration retries with a collector, doubled after each failure
+#define REGISTRATION_INTERVAL 2
+//Upper bound of the registration retry interval
+#define REGISTRATION_MAX_INTERVAL 64
+//Lifetime of the registration in the collector, refreshed before it expires
+#define REGISTRATION_LIFETIME 300
+//Block size used to send the resource list
+#define REGISTRATION_BLOCK_SIZE 64
+//Interval of the refreshes checking that the primary collector is alive
+#define LIVENESS_INTERVAL 15
+//Seconds the primary has to answer a refresh, well below the CoAP retransmission timeout
+#define LIVENESS_TIMEOUT 8
+//Missed liveness deadlines before switching to a standby collector
+#define LIVENESS_FAILURES 2
+
+//URL for registration
+static const char *service_url = "/registration";
+
+//Outcome of the last request sent to a collector
+enum registration_result {
+	REGISTRATION_TIMEOUT,   // no answer from the collector
+	REGISTRATION_CONTINUE,  // block accepted, send the next one
+	REGISTRATION_SUCCESS,   // registration created or refreshed
+	REGISTRATION_REJECTED   // refused, or refresh of a registration the collector does not know
+};
+
+//Registration with one collector, driven by its own timer and request
+struct collector {
+	const char *url;
+	coap_endpoint_t endpoint;
+	coap_callback_request_state_t request_state;
+	coap_message_t request[1];
+	struct etimer timer;               // next request, or liveness deadline while busy
+	bool registered;
+	bool busy;                         // a request is waiting for its answer
+	bool sent_as_primary;              // role announced in the last request
+	bool answered;                     // the answer is waiting to be handled by the process
+	bool restarted;                    // registered before a reboot, not yet refreshed
+	enum registration_result result;
+	uint16_t block_num;                // block of the resource list being sent
+	uint16_t interval;                 // retry interval, in seconds
+	uint8_t failures;                  // consecutive requests or deadlines missed
+	uint32_t expiry;                   // uptime in seconds when the registration expires
+};
+
+static const char *collector_urls[] = COLLECTOR_ENDPOINTS;
+#define COLLECTORS_COUNT (sizeof(collector_urls) / sizeof(collector_urls[0]))
+
+static struct collector collectors[COLLECTORS_COUNT];
+//Index of the collector observing the node
+static uint8_t primary = 0;
+//Process receiving the answers of the collectors
+static struct process *registration_process;
+
+//Resource list sent with the registration, in link format
+static char registration_payload[256];
+static uint16_t registration_payload_len;
+
+
+/** Returns a random delay between half and all of the given interval.
+ * The jitter keeps the nodes from retrying in lockstep after a reboot of
+ * the border router.
+ */
+static clock_time_t registration_jitter(uint16_t interval) {
+	clock_time_t base = (CLOCK_SECOND * interval) / 2;
+	return base + (random_rand() % (base + 1));
+}
+
+
+/** Builds the list of the active resources in link format,
+ * e.g. "</glucose/level>,</glucose/history>,...", as registration payload.
+ */
+static void build_registration_payload() {
+	coap_resource_t *resource;
+
+	registration_payload_len = 0;
+	for(resource = coap_get_first_resource(); resource != NULL; resource = coap_get_next_resource(resource)) {
+		int len;
+
+		// The collector always knows about the core resource
+		if(strncmp(resource->url, ".well-known", 11) == 0) {
+			continue;
+		}
+		len = snprintf(registration_payload + registration_payload_len,
+		               sizeof(registration_payload) - registration_payload_len, "%s</%s>",
+		               registration_payload_len > 0 ? "," : "", resource->url);
+		if(len >= (int)(sizeof(registration_payload) - registration_payload_len)) {
+			LOG_WARN("Resource list truncated at %s\n", resource->url);
+			break;
+		}
+		registration_payload_len += len;
+	}
+}
+
+
+//Saves the registrations when the node registers, loses a registration or switches primary
+static void registration_changed() {
+#if WITH_PERSISTENCE
+	persistence_save();
+#endif
+}
+
+
+/** Handler for the answers of a collector, called by the CoAP engine.
+ * If the recieved response is NULL, it indicates a timeout.
+ * A 2.31 Continue response acknowledges a block of the resource list.
+ * If the response contains "Success", the registration was created or refreshed.
+ * Any other response means that the collector refused it.
+ * The outcome is handed to the registration process, which sends the next request.
+ */
+static void registration_callback(coap_callback_request_state_t *state) {
+	struct collector *collector = state->state.user_data;
+	coap_message_t *response = state->state.response;
+	const uint8_t *chunk;
+	int len;
+
+	switch(state->state.status) {
+	case COAP_REQUEST_STATUS_RESPONSE:
+		if(response->code == CONTINUE_2_31) {
+			collector->result = REGISTRATION_CONTINUE;
+			break;
+		}
+		// Check if the payload contains "Success"
+		len = coap_get_payload(response, &chunk);
+		if(len == 7 && strncmp((char *)chunk, "Success", len) == 0) {
+			collector->result = REGISTRATION_SUCCESS;
+		} else {
+			collector->result = REGISTRATION_REJECTED;
+		}
+		break;
+	case COAP_REQUEST_STATUS_TIMEOUT:
+		collector->result = REGISTRATION_TIMEOUT;
+		break;
+	case COAP_REQUEST_STATUS_FINISHED:
+		break;
+	default:
+		collector->result = REGISTRATION_REJECTED;
+		break;
+	}
+
+	// The request is over: the process may send the next one
+	if(state->state.status != COAP_REQUEST_STATUS_RESPONSE) {
+		collector->busy = false;
+		collector->answered = true;
+		process_poll(registration_process);
+	}
+}
+
+
+/** Sends the next request to the collector, with its lifetime and role in the query.
+ * Until the collector registers the node, the block `block_num` of the resource
+ * list is sent as Block1 payload; a refresh carries no payload. The first refresh
+ * after a warm restart adds "boot=1", since the observations of the collector
+ * did not survive the reboot.
+ */
+static void send_registration(struct collector *collector) {
+	static char query[32];
+	coap_message_t *request = collector->request;
+
+	collector->sent_as_primary = collector == &collectors[primary];
+	snprintf(query, sizeof(query), "lt=%u&role=%s%s", REGISTRATION_LIFETIME,
+	         collector->sent_as_primary ? "primary" : "standby", collector->restarted ? "&boot=1" : "");
+	coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
+	coap_set_header_uri_path(request, service_url);
+	coap_set_header_uri_query(request, query);
+
+	if(!collector->registered) {
+		uint16_t offset = collector->block_num * REGISTRATION_BLOCK_SIZE;
+		uint16_t len = MIN(registration_payload_len - offset, REGISTRATION_BLOCK_SIZE);
+
+		coap_set_header_block1(request, collector->block_num, offset + len < registration_payload_len, REGISTRATION_BLOCK_SIZE);
+		coap_set_payload(request, (uint8_t *)registration_payload + offset, len);
+	}
+
+	collector->request_state.state.user_data = collector;
+	if(coap_send_request(&collector->request_state, &collector->endpoint, request, registration_callback)) {
+		coap_stats_registration_sent();
+		collector->busy = true;
+		if(collector->sent_as_primary) {
+			// Do not wait for the CoAP retransmissions to give up on the primary
+			etimer_set(&collector->timer, CLOCK_SECOND * LIVENESS_TIMEOUT);
+		}
+	} else {
+		// No transaction available: try again shortly
+		etimer_set(&collector->timer, registration_jitter(REGISTRATION_INTERVAL));
+	}
+}
+
+
+/** Picks as primary the first collector, in order of preference, that is
+ * still registered and answering, keeping the current one if none is.
+ * The new primary is refreshed at once, so that it starts observing; the old
+ * one learns its standby role with its next retry.
+ */
+static void select_primary() {
+	uint8_t i;
+
+	for(i = 0; i < COLLECTORS_COUNT; i++) {
+		if(i != primary && collectors[i].registered && collectors[i].failures == 0) {
+			LOG_WARN("Collector %s unreachable, switching to %s\n", collectors[primary].url, collectors[i].url);
+			primary = i;
+			if(!collectors[i].busy) {
+				etimer_set(&collectors[i].timer, 0);
+			}
+			registration_changed();
+			return;
+		}
+	}
+}
+
+
+//Schedules a retry of the current request with exponential backoff and jitter
+static void retry_later(struct collector *collector) {
+	etimer_set(&collector->timer, registration_jitter(collector->interval));
+	collector->interval = MIN(collector->interval * 2, REGISTRATION_MAX_INTERVAL);
+}
+
+
+/** Handles the answer of a collector and schedules its next request.
+ * The primary is refreshed every LIVENESS_INTERVAL, so that a failure is
+ * detected within seconds, the standbys only before the lifetime expires.
+ */
+static void handle_answer(struct collector *collector) {
+	switch(collector->result) {
+	case REGISTRATION_CONTINUE:
+		collector->block_num++;
+		send_registration(collector);
+		return;
+
+	case REGISTRATION_SUCCESS:
+		collector->restarted = false;
+		if(!collector->registered) {
+			LOG_INFO("Registered with %s for %u s\n", collector->url, REGISTRATION_LIFETIME);
+			collector->registered = true;
+			registration_changed();
+		}
+		collector->failures = 0;
+		collector->interval = REGISTRATION_INTERVAL;
+		collector->expiry = clock_seconds() + REGISTRATION_LIFETIME;
+		if(collector->sent_as_primary != (collector == &collectors[primary])) {
+			// The role changed while the request was in flight
+			etimer_set(&collector->timer, 0);
+		} else if(collector == &collectors[primary]) {
+			etimer_set(&collector->timer, registration_jitter(LIVENESS_INTERVAL));
+		} else {
+			// Refresh at a random point between 3/8 and 3/4 of the lifetime
+			etimer_set(&collector->timer, registration_jitter(REGISTRATION_LIFETIME * 3 / 4));
+		}
+		return;
+
+	case REGISTRATION_REJECTED:
+		coap_stats_registration_failed();
+		// The collector lost the registration: register again
+		if(collector->registered) {
+			LOG_INFO("Registration with %s lost, registering again\n", collector->url);
+			collector->registered = false;
+			collector->restarted = false;
+			registration_changed();
+		}
+		break;
+
+	case REGISTRATION_TIMEOUT:
+		coap_stats_registration_failed();
+		collector->failures++;
+		if(collector->registered && (int32_t)(collector->expiry - clock_seconds()) <= 0) {
+			collector->registered = false;
+			collector->restarted = false;
+			registration_changed();
+		}
+		break;
+	}
+
+	collector->block_num = 0;
+	if(collector == &collectors[primary] && collector->failures >= LIVENESS_FAILURES) {
+		select_primary();
+	}
+	retry_later(collector);
+}
+
+
+//Checksum of the collector endpoints, so that a saved state is dropped when they change
+static uint16_t endpoints_checksum() {
+	uint16_t crc = 0;
+	uint8_t i;
+
+	for(i = 0; i < COLLECTORS_COUNT; i++) {
+		crc = crc16_data((const unsigned char *)collector_urls[i], strlen(collector_urls[i]), crc);
+	}
+	return crc;
+}
+
+
+void registration_snapshot(struct registration_snapshot *snapshot) {
+	uint8_t i;
+
+	snapshot->endpoints = endpoints_checksum();
+	snapshot->primary = primary;
+	snapshot->registered = 0;
+	for(i = 0; i < COLLECTORS_COUNT && i < 8; i++) {
+		if(collectors[i].registered) {
+			snapshot->registered |= 1 << i;
+		}
+	}
+}
+
+
+/** Takes over the registrations of the previous run. Their lifetime is assumed
+ * to be whole: a collector that dropped the registration meanwhile answers the
+ * refresh with "Unknown", and the node registers again.
+ */
+void registration_restore(const struct registration_snapshot *snapshot) {
+	uint8_t i;
+
+	if(snapshot->endpoints != endpoints_checksum() || snapshot->primary >= COLLECTORS_COUNT) {
+		LOG_INFO("Collectors changed since the saved state, registering again\n");
+		return;
+	}
+	primary = snapshot->primary;
+	for(i = 0; i < COLLECTORS_COUNT && i < 8; i++) {
+		if(snapshot->registered & (1 << i)) {
+			collectors[i].registered = true;
+			collectors[i].restarted = true;
+			collectors[i].expiry = clock_seconds() + REGISTRATION_LIFETIME;
+		}
+	}
+}
+
+
+void registration_start(void) {
+	uint8_t i;
+
+	registration_process = PROCESS_CURRENT();
+	build_registration_payload();
+	for(i = 0; i < COLLECTORS_COUNT; i++) {
+		struct collector *collector = &collectors[i];
+
+		collector->url = collector_urls[i];
+		coap_endpoint_parse(collector->url, strlen(collector->url), &collector->endpoint);
+		collector->interval = REGISTRATION_INTERVAL;
+		if(collector->restarted) {
+			// Warm restart: tell the collector at once, so that it observes the node again
+			etimer_set(&collector->timer, 0);
+			continue;
+		}
+		// Wait a random part of the first retry interval, so that the nodes
+		// joining together do not all register at the same time
+		etimer_set(&collector->timer, registration_jitter(REGISTRATION_INTERVAL));
+	}
+}
+
+
+/** Restarts the registrations backed off while the node was out of the
+ * network, so that they do not wait for the end of their retry interval.
+ */
+void registration_network_up(void) {
+	uint8_t i;
+
+	for(i = 0; i < COLLECTORS_COUNT; i++) {
+		struct collector *collector = &collectors[i];
+
+		if(!collector->busy && !collector->registered && collector->interval > REGISTRATION_INTERVAL) {
+			collector->interval = REGISTRATION_INTERVAL;
+			etimer_set(&collector->timer, registration_jitter(REGISTRATION_INTERVAL));
+		}
+	}
+}
+
+
+/** Counts a liveness deadline missed by the primary, which switches to a
+ * standby after LIVENESS_FAILURES. The request itself stays pending until
+ * the CoAP engine gives up on it.
+ */
+static void liveness_missed(struct collector *collector) {
+	if(!collector->sent_as_primary || collector != &collectors[primary]) {
+		return;
+	}
+	collector->failures++;
+	if(collector->failures >= LIVENESS_FAILURES) {
+		select_primary();
+	}
+	if(collector == &collectors[primary]) {
+		etimer_set(&collector->timer, CLOCK_SECOND * LIVENESS_TIMEOUT);
+	}
+}
+
+
+/** Sends the requests whose timer expired and handles the answers received
+ * since the last poll. Each collector is handled on its own, so a silent
+ * collector never delays the others.
+ */
+void registration_handle_event(process_event_t ev, process_data_t data) {
+	uint8_t i;
+
+	for(i = 0; i < COLLECTORS_COUNT; i++) {
+		struct collector *collector = &collectors[i];
+
+		if(ev == PROCESS_EVENT_TIMER && data == &collector->timer) {
+			if(collector->busy) {
+				liveness_missed(collector);
+			} else {
+				send_registration(collector);
+			}
+		} else if(ev == PROCESS_EVENT_POLL && collector->answered) {
+			collector->answered = false;
+			handle_answer(collector);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+#include "contiki.h"
+
+//Collectors the node registers with, in order of preference: the first one
+//reachable is the primary, which observes the node, the others are standbys
+#ifdef COLLECTOR_CONF_ENDPOINTS
+#define COLLECTOR_ENDPOINTS COLLECTOR_CONF_ENDPOINTS
+#else
+#define COLLECTOR_ENDPOINTS { "coap://[fd00::1]:5683", "coap://[fd00::2]:5683" }
+#endif
+
+//Registration state kept across restarts
+struct registration_snapshot {
+	uint16_t endpoints;   // checksum of the collector endpoints the state refers to
+	uint8_t primary;      // index of the primary collector
+	uint8_t registered;   // bit i set if the node is registered with collector i
+};
+
+//Starts registering with every collector; must be called from the process
+//that then passes all its events to registration_handle_event()
+void registration_start(void);
+
+//Drives the registrations on the timer and poll events of the calling process
+void registration_handle_event(process_event_t ev, process_data_t data);
+
+//Retries at once the registrations delayed while the node was out of the network
+void registration_network_up(void);
+
+//Saves the primary collector and the collectors the node is registered with
+void registration_snapshot(struct registration_snapshot *snapshot);
+
+//Restores a saved state before registration_start(): the collectors the node
+//was registered with are refreshed at once instead of registering again
+void registration_restore(const struct registration_snapshot *snapshot);
+
+#endif /* REGISTRATION_H */
@@ -0,0 +1,28 @@
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "block_buffer.h"
+
+void block_buffer_send(coap_message_t *response, uint8_t *buffer, uint16_t preferred_size,
+                       int32_t *offset, const char *representation, int32_t length, uint16_t tag) {
+	uint8_t etag[2] = { tag >> 8, tag };
+	int32_t len;
+
+	// Check the offset for boundaries of the resource data
+	if(*offset >= length) {
+		coap_set_status_code(response, BAD_OPTION_4_02);
+		coap_set_payload(response, "BlockOutOfScope", 15);
+		return;
+	}
+
+	coap_set_header_etag(response, etag, sizeof(etag));
+	len = MIN(length - *offset, preferred_size);
+	memcpy(buffer, representation + *offset, len);
+	coap_set_payload(response, buffer, len);
+
+	// Signal the next block to the engine, or the end of the representation
+	*offset += len;
+	if(*offset >= length) {
+		*offset = -1;
+	}
+}
@@ -0,0 +1,16 @@
+#ifndef BLOCK_BUFFER_H
+#define BLOCK_BUFFER_H
+
+#include "coap-engine.h"
+
+/** Sends the block [*offset, *offset + preferred_size) of a representation
+ * held in memory and updates the offset for the Block2 transfer (-1 after
+ * the last block). Offsets beyond the representation get 4.02 Bad Option.
+ * Every block carries the tag of the representation as ETag: the snapshot is
+ * shared by all the clients, so a client that sees the ETag change in the
+ * middle of a transfer restarts it from block 0 (RFC 7959, section 2.4).
+ */
+void block_buffer_send(coap_message_t *response, uint8_t *buffer, uint16_t preferred_size,
+                       int32_t *offset, const char *representation, int32_t length, uint16_t tag);
+
+#endif /* BLOCK_BUFFER_H */
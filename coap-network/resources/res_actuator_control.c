@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "actuators.h"
+#include "global_variables.h"
+#include "traffic_class.h"
+#if WITH_MULTICAST
+#include "multicast_group.h"
+#endif
+#include "sys/log.h"
+
+/* Log configuration */
+#define LOG_MODULE "actuator-control"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Prefix of the path of every actuator resource
+#define ACTUATOR_PATH_PREFIX "glucose_control/"
+
+// Declaration of the PUT handler function shared by all the actuators
+static void control_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+/** Defines an actuator table entry together with its CoAP resource.
+ * The resource has the title of the actuator and resource type "Control",
+ * and its PUT method is handled by the shared "control_put_handler".
+ * The initializer follows the one of the RESOURCE() macro.
+ */
+#define ACTUATOR(key, title, flag) \
+	{ key, title, ACTUATOR_PATH_PREFIX key, &flag, \
+	  { NULL, NULL, NO_FLAGS, "title=\"" title "\";rt=\"Control\"", \
+	    NULL, NULL, control_put_handler, NULL, { NULL } } }
+
+//Process reacting to the actuator changes
+PROCESS_NAME(actuator_simulation);
+
+//Resource notifying the actuator state changes
+extern coap_resource_t res_state_control;
+
+process_event_t actuator_event;
+
+/** Table of the actuators of the node.
+ * Adding an actuator only needs a new entry: its resource is activated at
+ * glucose_control/<key> and glucose_control/state handles it as "<key>=ON|OFF".
+ */
+static struct actuator actuators[] = {
+	ACTUATOR("insulin", "Insulin", insulin_activate),
+	ACTUATOR("glucagon", "Glucagon", glucagon_activate),
+	ACTUATOR("alert", "Alert", alert_activate),
+};
+
+#define ACTUATORS_COUNT (sizeof(actuators) / sizeof(actuators[0]))
+
+
+/** Allocates the actuator event and activates the resource of every actuator. */
+void actuators_init(void) {
+	size_t i;
+
+	actuator_event = process_alloc_event();
+	for(i = 0; i < ACTUATORS_COUNT; i++) {
+		coap_activate_resource(&actuators[i].resource, actuators[i].path);
+	}
+}
+
+
+size_t actuators_count(void) {
+	return ACTUATORS_COUNT;
+}
+
+
+struct actuator *actuators_get(size_t index) {
+	return index < ACTUATORS_COUNT ? &actuators[index] : NULL;
+}
+
+
+/** Signals a change of the actuator states.
+ * The actuator process is woken up by an event instead of polling the flags,
+ * and the observers of glucose_control/state are notified as alert traffic.
+ */
+void actuators_changed(void) {
+	process_post(&actuator_simulation, actuator_event, NULL);
+	traffic_class_alert_begin();
+	res_state_control.trigger();
+	traffic_class_alert_end();
+}
+
+
+/** Put_Handler for CoAP PUT requests to control one actuator.
+ * The actuator is looked up in the table from the path of the request.
+ * It expects a variable named "status" with the value "ON" or "OFF"
+ * and updates the global flag of the actuator accordingly.
+ * If the request is invalid, it sets the response status to 400 (Bad Request).
+ * A request sent to the multicast group of the nodes must be non-confirmable,
+ * and gets no response.
+ */
+static void control_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	struct actuator *actuator = NULL;
+	const char *path = NULL;
+	const char *text = NULL;
+	size_t path_len = coap_get_header_uri_path(request, &path);
+	bool group = false;
+	size_t len;
+	size_t i;
+
+#if WITH_MULTICAST
+	group = multicast_group_request();
+	// Confirmable requests cannot be sent to a group (RFC 7252, 8.1)
+	if(group && !multicast_group_no_response(request)) {
+		return;
+	}
+#endif
+
+	// Find the actuator addressed by the request
+	for(i = 0; i < ACTUATORS_COUNT; i++) {
+		if(path_len == strlen(actuators[i].path) && strncmp(path, actuators[i].path, path_len) == 0) {
+			actuator = &actuators[i];
+			break;
+		}
+	}
+	if(actuator == NULL) {
+		coap_set_status_code(response, NOT_FOUND_4_04);
+		return;
+	}
+
+	// Retrieve the "status" variable from the request
+	len = coap_get_post_variable(request, "status", &text);
+	if(len == 2 && strncmp(text, "ON", len) == 0) {
+		*actuator->state = true;
+	} else if(len == 3 && strncmp(text, "OFF", len) == 0) {
+		*actuator->state = false;
+	} else {
+		//set the response status code to 400 (Bad Request)
+		coap_set_status_code(response, BAD_REQUEST_4_00);
+		return;
+	}
+
+	printf("%s %s%s\n", actuator->title, *actuator->state ? "Activated" : "Deactivated",
+	       group ? " by group" : "");
+	// The acknowledgement of the command goes out as alert traffic too,
+	// right after the handler returns; a group request gets none
+	if(!group) {
+		const coap_endpoint_t *endpoint = coap_get_src_endpoint(request);
+		traffic_class_alert_flow(&endpoint->ipaddr, UIP_NTOHS(endpoint->port), CLOCK_SECOND);
+	}
+	actuators_changed();
+}
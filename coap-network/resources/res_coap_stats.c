@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-observe.h"
+#include "sys/log.h"
+#include "block_buffer.h"
+#include "coap_stats.h"
+#if WITH_OSCORE
+#include "glucose_oscore.h"
+#endif
+
+/* Log configuration */
+#define LOG_MODULE "coap-stats"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Resources whose requests are counted one by one, the others are counted together
+#define STATS_RESOURCES_MAX 16
+//Distinct response codes counted
+#define STATS_CODES_MAX 12
+//Recent confirmable messages remembered to recognise retransmissions
+#define STATS_RECENT_CON (2 * COAP_MAX_OPEN_TRANSACTIONS)
+//Longest resource path expected in the snapshot
+#define STATS_PATH_MAX 32
+//Largest representation with every counter at 10 digits: the fixed part, then
+//"<path>":<count>, per resource and "x.yy":<count>, per response code
+#define STATS_SNAPSHOT_SIZE (160 + STATS_RESOURCES_MAX * (STATS_PATH_MAX + 14) + STATS_CODES_MAX * 18)
+
+//Real functions behind the wrappers installed with -Wl,--wrap (see the Makefile)
+int __real_coap_sendto(const coap_endpoint_t *ep, const uint8_t *data, uint16_t len);
+coap_transaction_t *__real_coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint);
+
+//Number of answers sent with one response code
+struct code_count {
+	uint8_t code;
+	uint32_t count;
+};
+
+//Counters, all reset together
+static struct {
+	uint32_t requests[STATS_RESOURCES_MAX + 1];  // per resource in activation order, then the others
+	struct code_count codes[STATS_CODES_MAX];
+	uint32_t retransmissions;                     // confirmable messages sent again
+	uint32_t transactions_exhausted;              // transactions refused, answered 5.03 or not sent
+	uint8_t transactions_peak;                    // open transactions high-water mark
+	uint32_t registrations_sent;
+	uint32_t registrations_failed;
+} stats;
+
+//Open transactions, to compute the high-water mark
+static struct {
+	coap_transaction_t *transaction;
+	uint16_t mid;
+} open_transactions[COAP_MAX_OPEN_TRANSACTIONS];
+
+//Message IDs of the last confirmable messages sent
+static uint16_t recent_con[STATS_RECENT_CON];
+static uint8_t recent_con_next;
+
+//Representation of the statistics, taken when the first block is requested
+static char snapshot[STATS_SNAPSHOT_SIZE];
+static int32_t snapshot_len;
+//Changed with every snapshot, sent as ETag
+static uint16_t snapshot_tag;
+
+// Declaration of the GET and POST handlers and of the request counter
+static void coap_stats_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void coap_stats_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static coap_handler_status_t count_request(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t buffer_size, int32_t *offset);
+
+
+/**CoAP resource definition for the statistics of the CoAP engine.
+ * This defines a CoAP resource named `res_coap_stats` with the title "CoAP".
+ * It supports the GET method, which is handled by the `coap_stats_get_handler` function,
+ * and the POST method, which resets the counters (`coap_stats_post_handler`).
+ */
+RESOURCE(res_coap_stats,
+         "title=\"CoAP\";rt=\"Stats\"",
+         coap_stats_get_handler,
+         coap_stats_post_handler,
+         NULL,
+         NULL);
+
+//Engine handler called before the resources: it only counts the request
+COAP_HANDLER(request_counter, count_request);
+
+
+void coap_stats_init(void) {
+	coap_add_handler(&request_counter);
+}
+
+
+void coap_stats_registration_sent(void) {
+	stats.registrations_sent++;
+}
+
+
+void coap_stats_registration_failed(void) {
+	stats.registrations_failed++;
+}
+
+
+/* Counts a request under the resource it addresses.
+ * The resources are few, so the path is compared with each of them.
+ * Notifications also run the handlers, with a request built by the engine
+ * that has no source endpoint: they are not requests and are not counted.
+ */
+static coap_handler_status_t count_request(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t buffer_size, int32_t *offset) {
+	const char *path = NULL;
+	size_t len;
+	coap_resource_t *resource;
+	uint8_t i = 0;
+
+	if(coap_get_src_endpoint(request) == NULL) {
+		return COAP_HANDLER_STATUS_CONTINUE;
+	}
+	len = coap_get_header_uri_path(request, &path);
+
+	for(resource = coap_get_first_resource(); resource != NULL && i < STATS_RESOURCES_MAX;
+	    resource = coap_get_next_resource(resource), i++) {
+		if(len == strlen(resource->url) && strncmp(path, resource->url, len) == 0) {
+			break;
+		}
+	}
+	if(resource == NULL) {
+		i = STATS_RESOURCES_MAX;
+	}
+	stats.requests[i]++;
+	return COAP_HANDLER_STATUS_CONTINUE;
+}
+
+
+/* Wrapper of coap_sendto(), through which every CoAP message leaves the node.
+ * It counts the answers by response code, and the confirmable messages sent
+ * again with a recent message ID, which are the retransmissions. It also keeps
+ * the OSCORE sequence numbers reserved in flash ahead of the messages.
+ */
+int __wrap_coap_sendto(const coap_endpoint_t *ep, const uint8_t *data, uint16_t len) {
+	if(len >= 4) {
+		uint8_t type = (data[0] >> 4) & 0x03;
+		uint8_t code = data[1];
+		uint16_t mid = ((uint16_t)data[2] << 8) | data[3];
+		uint8_t i;
+
+		if(type == COAP_TYPE_CON) {
+			for(i = 0; i < STATS_RECENT_CON && recent_con[i] != mid; i++);
+			if(i < STATS_RECENT_CON) {
+				stats.retransmissions++;
+			} else {
+				recent_con[recent_con_next] = mid;
+				recent_con_next = (recent_con_next + 1) % STATS_RECENT_CON;
+			}
+		}
+
+		// Response codes are 2.xx to 5.xx
+		if(code >= CREATED_2_01) {
+			for(i = 0; i < STATS_CODES_MAX && stats.codes[i].count > 0 && stats.codes[i].code != code; i++);
+			if(i < STATS_CODES_MAX) {
+				stats.codes[i].code = code;
+				stats.codes[i].count++;
+			}
+		}
+	}
+#if WITH_OSCORE
+	glucose_oscore_sent();
+#endif
+	return __real_coap_sendto(ep, data, len);
+}
+
+
+/* Wrapper of coap_new_transaction(), called for every confirmable message.
+ * It tracks the high-water mark of the open transactions and counts the
+ * transactions refused because the pool of COAP_MAX_OPEN_TRANSACTIONS is full.
+ */
+coap_transaction_t *__wrap_coap_new_transaction(uint16_t mid, const coap_endpoint_t *endpoint) {
+	coap_transaction_t *transaction = __real_coap_new_transaction(mid, endpoint);
+	uint8_t open = 0;
+	uint8_t i;
+
+	if(transaction == NULL) {
+		stats.transactions_exhausted++;
+		return NULL;
+	}
+
+	// A slot is free when the engine no longer knows its transaction
+	for(i = 0; i < COAP_MAX_OPEN_TRANSACTIONS; i++) {
+		if(open_transactions[i].transaction != NULL &&
+		   coap_get_transaction_by_mid(open_transactions[i].mid) != open_transactions[i].transaction) {
+			open_transactions[i].transaction = NULL;
+		}
+	}
+	for(i = 0; i < COAP_MAX_OPEN_TRANSACTIONS; i++) {
+		if(open_transactions[i].transaction == NULL || open_transactions[i].transaction == transaction) {
+			open_transactions[i].transaction = transaction;
+			open_transactions[i].mid = mid;
+			break;
+		}
+	}
+	for(i = 0; i < COAP_MAX_OPEN_TRANSACTIONS; i++) {
+		open += open_transactions[i].transaction != NULL;
+	}
+	stats.transactions_peak = MAX(stats.transactions_peak, open);
+	return transaction;
+}
+
+
+/* Builds the JSON representation of the statistics into the snapshot:
+ * {"requests":{"<path>":..,"other":..},"responses":{"2.05":..,...},
+ *  "retransmissions":..,"transactions":[peak,max,exhausted],"observers":..,
+ *  "registrations":[sent,failed]}
+ * Returns false if the representation does not fit in the snapshot, which
+ * is then left empty rather than holding truncated JSON.
+ */
+static bool take_snapshot(void) {
+	coap_resource_t *resource;
+	bool complete = true;
+	uint8_t i = 0;
+
+#define APPEND(...) snapshot_len += snprintf(snapshot + snapshot_len, sizeof(snapshot) - snapshot_len, __VA_ARGS__); \
+	if(snapshot_len >= (int32_t)sizeof(snapshot)) { \
+		complete = false; \
+		snapshot_len = sizeof(snapshot) - 1; \
+	}
+
+	snapshot_len = 0;
+	APPEND("{\"requests\":{");
+	for(resource = coap_get_first_resource(); resource != NULL && i < STATS_RESOURCES_MAX;
+	    resource = coap_get_next_resource(resource), i++) {
+		APPEND("\"%s\":%lu,", resource->url, (unsigned long)stats.requests[i]);
+	}
+	APPEND("\"other\":%lu},\"responses\":{", (unsigned long)stats.requests[STATS_RESOURCES_MAX]);
+	for(i = 0; i < STATS_CODES_MAX && stats.codes[i].count > 0; i++) {
+		APPEND("%s\"%u.%02u\":%lu", i > 0 ? "," : "", stats.codes[i].code >> 5, stats.codes[i].code & 0x1f,
+		       (unsigned long)stats.codes[i].count);
+	}
+	APPEND("},\"retransmissions\":%lu,\"transactions\":[%u,%u,%lu],\"observers\":%d,\"registrations\":[%lu,%lu]}",
+	       (unsigned long)stats.retransmissions, stats.transactions_peak, COAP_MAX_OPEN_TRANSACTIONS,
+	       (unsigned long)stats.transactions_exhausted, list_length(coap_get_observers()),
+	       (unsigned long)stats.registrations_sent, (unsigned long)stats.registrations_failed);
+#undef APPEND
+
+	snapshot_tag++;
+	if(!complete) {
+		LOG_ERR("CoAP statistics longer than %u bytes\n", (unsigned)sizeof(snapshot));
+		snapshot_len = 0;
+	}
+	return complete;
+}
+
+
+/* GET_Handler for CoAP GET requests to read the CoAP engine statistics.
+ * The statistics are captured when the first block is requested and the
+ * following blocks are served from that snapshot, so a Block2 transfer is
+ * consistent. Each snapshot has its own ETag.
+ */
+static void coap_stats_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	if(*offset == 0 && !take_snapshot()) {
+		coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+		return;
+	}
+
+	coap_set_header_content_format(response, APPLICATION_JSON);
+	block_buffer_send(response, buffer, preferred_size, offset, snapshot, snapshot_len, snapshot_tag);
+}
+
+
+/* POST_Handler for CoAP POST requests to reset the CoAP engine statistics.
+ * A reset changes the state of the node, so it is not done by a GET.
+ */
+static void coap_stats_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	memset(&stats, 0, sizeof(stats));
+	LOG_INFO("CoAP statistics reset\n");
+	coap_set_status_code(response, CHANGED_2_04);
+}
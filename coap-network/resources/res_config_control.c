@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "global_variables.h"
+#if WITH_PERSISTENCE
+#include "persistence.h"
+#endif
+#include "sys/log.h"
+
+/* Log configuration */
+#define LOG_MODULE "config-control"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+// Declaration of the GET and PUT handler functions
+static void config_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void config_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+
+/**CoAP resource definition for the configuration of the glucose controller.
+ * it defines a CoAP resource named "res_config_control" with the title "Controller"
+ * and resource type "Config". The cloud uses it to push the thresholds of the
+ * controller running on the node and to switch it on or off.
+ */
+RESOURCE(res_config_control,
+         "title=\"Controller\";rt=\"Config\"",
+         config_get_handler,
+         NULL,
+         config_put_handler,
+         NULL);
+
+
+/** Reads the integer variable `name` of the request payload.
+ * Returns 1 and stores the number in `value` if the variable is a valid
+ * glucose level, 0 if the variable is absent and -1 if it is invalid.
+ */
+static int get_threshold_variable(coap_message_t *request, const char *name, int *value) {
+	const char *text = NULL;
+	char number[4]; // Buffer to store the value (max 3 digits + null terminator)
+	char *end;
+	size_t len = coap_get_post_variable(request, name, &text);
+
+	if(len == 0) {
+		return 0;
+	}
+	if(len >= sizeof(number)) {
+		return -1;
+	}
+	memcpy(number, text, len);
+	number[len] = '\0';
+	*value = (int)strtol(number, &end, 10);
+	if(*end != '\0' || *value <= 0) {
+		return -1;
+	}
+	return 1;
+}
+
+
+/** Put_Handler for CoAP PUT requests to configure the glucose controller.
+ * It accepts the variables "high", "insulin", "glucagon" and "low" with the
+ * thresholds in mg/dL, and "auto" with the value "ON" or "OFF" to enable or
+ * disable the controller, e.g. "high=180&insulin=120&glucagon=70&low=50&auto=ON".
+ * A variable left out keeps its current value. The new thresholds must keep
+ * the order low < glucagon < insulin < high.
+ * If the request is invalid, it sets the response status to 400 (Bad Request)
+ * and the configuration is left unchanged.
+ */
+static void config_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	struct glucose_thresholds thresholds = glucose_thresholds;
+	bool enabled = edge_control_enabled;
+	const char *text = NULL;
+	size_t len;
+	bool response_status = true;
+
+	if(get_threshold_variable(request, "high", &thresholds.alert_high) < 0 ||
+	   get_threshold_variable(request, "insulin", &thresholds.insulin) < 0 ||
+	   get_threshold_variable(request, "glucagon", &thresholds.glucagon) < 0 ||
+	   get_threshold_variable(request, "low", &thresholds.alert_low) < 0) {
+		response_status = false;
+	}
+
+	// Retrieve the optional "auto" variable from the request
+	len = coap_get_post_variable(request, "auto", &text);
+	if(len == 2 && strncmp(text, "ON", len) == 0) {
+		enabled = true;
+	} else if(len == 3 && strncmp(text, "OFF", len) == 0) {
+		enabled = false;
+	} else if(len > 0) {
+		response_status = false;
+	}
+
+	// The bands must not overlap
+	if(!(thresholds.alert_low < thresholds.glucagon &&
+	     thresholds.glucagon < thresholds.insulin &&
+	     thresholds.insulin < thresholds.alert_high)) {
+		response_status = false;
+	}
+
+	if(!response_status) {
+		//set the response status code to 400 (Bad Request)
+		coap_set_status_code(response, BAD_REQUEST_4_00);
+		return;
+	}
+
+	glucose_thresholds = thresholds;
+	edge_control_enabled = enabled;
+	LOG_INFO("Controller %s: high %d, insulin %d, glucagon %d, low %d\n", enabled ? "ON" : "OFF",
+	         thresholds.alert_high, thresholds.insulin, thresholds.glucagon, thresholds.alert_low);
+#if WITH_PERSISTENCE
+	persistence_save();
+#endif
+	coap_set_status_code(response, CHANGED_2_04);
+}
+
+
+/** Get_Handler for CoAP GET requests to read the controller configuration.
+ * It answers in the same form accepted by the PUT handler.
+ */
+static void config_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	int len = snprintf((char *)buffer, preferred_size, "high=%d&insulin=%d&glucagon=%d&low=%d&auto=%s",
+	                   glucose_thresholds.alert_high, glucose_thresholds.insulin,
+	                   glucose_thresholds.glucagon, glucose_thresholds.alert_low,
+	                   edge_control_enabled ? "ON" : "OFF");
+
+	// snprintf returns the length it would have written: keep the truncated text
+	if(len >= preferred_size) {
+		len = preferred_size - 1;
+	}
+	coap_set_header_content_format(response, TEXT_PLAIN);
+	coap_set_payload(response, buffer, len);
+}
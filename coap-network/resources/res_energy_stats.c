@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "sys/energest.h"
+#include "sys/rtimer.h"
+#include "sys/log.h"
+#include "block_buffer.h"
+#include "energy_stats.h"
+
+/* Log configuration */
+#define LOG_MODULE "energy-stats"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Energest counters reported by the resource
+static const energest_type_t energest_types[] = {
+	ENERGEST_TYPE_CPU, ENERGEST_TYPE_LPM, ENERGEST_TYPE_DEEP_LPM,
+	ENERGEST_TYPE_TRANSMIT, ENERGEST_TYPE_LISTEN
+};
+static const char *energest_names[] = { "cpu", "lpm", "deep_lpm", "tx", "rx" };
+#define ENERGEST_COUNTERS (sizeof(energest_types) / sizeof(energest_types[0]))
+
+//Names of the accounted processes, in the order of energy_stats.h
+static const char *process_names[STATS_PROCESS_COUNT] = { "server", "actuator", "sensor" };
+
+//CPU time spent by one process, measured between begin and end marks
+struct process_energy {
+	rtimer_clock_t start;  // start of the current activation
+	uint64_t ticks;        // rtimer ticks spent in the process
+	uint32_t activations;  // number of activations
+};
+
+static struct process_energy processes[STATS_PROCESS_COUNT];
+//Energest values at the last reset
+static energest_t energest_base[ENERGEST_COUNTERS];
+
+//Representation of the statistics, taken when the first block is requested
+static char snapshot[256];
+static int32_t snapshot_len;
+//Changed with every snapshot, sent as ETag
+static uint16_t snapshot_tag;
+
+// Declaration of the GET and POST handler functions
+static void energy_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void energy_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+
+/**CoAP resource definition for the energy statistics.
+ * This defines a CoAP resource named `res_energy_stats` with the title "Energy".
+ * It supports the GET method, which is handled by the `energy_get_handler` function,
+ * and the POST method, which resets the counters (`energy_post_handler`).
+ */
+RESOURCE(res_energy_stats,
+         "title=\"Energy\";rt=\"Stats\"",
+         energy_get_handler,
+         energy_post_handler,
+         NULL,
+         NULL);
+
+
+void energy_stats_begin(uint8_t process) {
+	processes[process].start = RTIMER_NOW();
+}
+
+
+void energy_stats_end(uint8_t process) {
+	processes[process].ticks += RTIMER_CLOCK_DIFF(RTIMER_NOW(), processes[process].start);
+	processes[process].activations++;
+}
+
+
+//Converts a number of ticks into milliseconds
+static unsigned long to_ms(uint64_t ticks, uint32_t second) {
+	return (unsigned long)(ticks * 1000 / second);
+}
+
+
+/* Builds the JSON representation of the statistics into the snapshot:
+ * {"cpu":..,"lpm":..,"deep_lpm":..,"tx":..,"rx":..,"server":[..,..],...}
+ * Energest counters are the time spent in each state since the last reset,
+ * each process gets [CPU time, number of activations]. Times are in ms.
+ */
+static void take_snapshot(void) {
+	energest_t values[ENERGEST_COUNTERS];
+	size_t i;
+
+	energest_flush();
+	snapshot_len = 0;
+	for(i = 0; i < ENERGEST_COUNTERS; i++) {
+		values[i] = energest_type_time(energest_types[i]);
+		snapshot_len += snprintf(snapshot + snapshot_len, sizeof(snapshot) - snapshot_len, "%s\"%s\":%lu",
+		                         i == 0 ? "{" : ",", energest_names[i],
+		                         to_ms(values[i] - energest_base[i], ENERGEST_SECOND));
+	}
+	for(i = 0; i < STATS_PROCESS_COUNT; i++) {
+		snapshot_len += snprintf(snapshot + snapshot_len, sizeof(snapshot) - snapshot_len, ",\"%s\":[%lu,%lu]",
+		                         process_names[i], to_ms(processes[i].ticks, RTIMER_SECOND),
+		                         (unsigned long)processes[i].activations);
+	}
+	snapshot_len += snprintf(snapshot + snapshot_len, sizeof(snapshot) - snapshot_len, "}");
+	snapshot_len = MIN(snapshot_len, (int32_t)sizeof(snapshot) - 1);
+	snapshot_tag++;
+}
+
+
+/* GET_Handler for CoAP GET requests to read the energy statistics.
+ * The statistics are captured when the first block is requested and the
+ * following blocks are served from that snapshot, so a Block2 transfer is
+ * consistent. Each snapshot has its own ETag.
+ */
+static void energy_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	if(*offset == 0) {
+		take_snapshot();
+	}
+
+	coap_set_header_content_format(response, APPLICATION_JSON);
+	block_buffer_send(response, buffer, preferred_size, offset, snapshot, snapshot_len, snapshot_tag);
+}
+
+
+/* POST_Handler for CoAP POST requests to reset the energy statistics.
+ * The Energest counters and the process counters restart from zero; a reset
+ * changes the state of the node, so it is not done by a GET that caches,
+ * proxies or retries could repeat.
+ */
+static void energy_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	size_t i;
+
+	energest_flush();
+	for(i = 0; i < ENERGEST_COUNTERS; i++) {
+		energest_base[i] = energest_type_time(energest_types[i]);
+	}
+	for(i = 0; i < STATS_PROCESS_COUNT; i++) {
+		processes[i].ticks = 0;
+		processes[i].activations = 0;
+	}
+	LOG_INFO("Energy statistics reset\n");
+	coap_set_status_code(response, CHANGED_2_04);
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "sys/log.h"
+#include "global_variables.h"
+
+/* Log configuration */
+#define LOG_MODULE "Glucose-history"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Beginning of the representation, sent before the first sample
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define HISTORY_HEADER "{\"patient_Id\":" TOSTRING(PATIENT_ID) ",\"samples\":["
+
+//Declaration of the GET handler function
+static void history_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+
+/**CoAP resource definition for the glucose history.
+ * This defines a CoAP resource named `res_glucose_history` with the title "Glucose History".
+ * It supports the GET method, which is handled by the `history_get_handler` function.
+ * The representation is larger than one CoAP chunk and is transferred with Block2.
+ */
+RESOURCE(res_glucose_history,
+         "title=\"Glucose History\";rt=\"History\"",
+         history_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+
+/* GET_Handler for CoAP GET requests to retrieve the stored glucose samples.
+ * The samples are returned, together with the patient id, as a JSON array of
+ * [seq, timestamp, glucose_level] entries, oldest first. The optional "since"
+ * query variable restricts the answer to samples with a sequence number
+ * greater than the given one.
+ * The whole representation is generated on every request and only the part
+ * falling inside the requested block (offset, preferred_size) is copied into
+ * the buffer, so the chunk never exceeds REST_MAX_CHUNK_SIZE.
+ * Every block carries the sequence number of the newest sample as ETag: a new
+ * sample moves the bytes of the representation, and a client whose blocks do
+ * not all carry the same ETag starts the transfer again.
+ */
+static void history_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    char entry[64]; // Buffer to store one formatted sample, including the header
+    char since_text[11]; // Buffer to store the "since" value (max 10 digits + null terminator)
+    const char *text = NULL;
+    const struct glucose_sample *last = glucose_history_get(glucose_history_count - 1);
+    uint8_t etag[4];
+    uint32_t seq = last != NULL ? last->seq : 0;
+    uint32_t since = 0;
+    int32_t position = 0; // Position of the current entry in the whole representation
+    int32_t start = *offset; // First byte of the requested block
+    int32_t end = *offset + preferred_size; // First byte after the requested block
+    uint16_t len = 0; // Number of bytes copied into the buffer
+    bool first = true;
+    uint8_t i;
+
+    // Retrieve the optional "since" variable from the query
+    size_t since_len = coap_get_query_variable(request, "since", &text);
+    if(since_len > 0 && since_len < sizeof(since_text)) {
+        memcpy(since_text, text, since_len);
+        since_text[since_len] = '\0';
+        since = strtoul(since_text, NULL, 10);
+    }
+
+    // Walk over the representation {"patient_Id":1,"samples":[entry,...]} and copy the bytes of the block
+    for(i = 0; i <= glucose_history_count; i++) {
+        int entry_len;
+
+        if(i < glucose_history_count) {
+            const struct glucose_sample *sample = glucose_history_get(i);
+            if(sample->seq <= since) {
+                continue;
+            }
+            entry_len = snprintf(entry, sizeof(entry), "%s[%lu,%lu,%d]", first ? HISTORY_HEADER : ",",
+                                 (unsigned long)sample->seq, (unsigned long)sample->timestamp, sample->level);
+            first = false;
+        } else {
+            // Close the array, or send an empty one if no sample matches
+            entry_len = snprintf(entry, sizeof(entry), "%s]}", first ? HISTORY_HEADER : "");
+        }
+
+        // Copy the part of the entry that overlaps the requested block
+        if(position + entry_len > start && position < end) {
+            int32_t from = MAX(start - position, 0);
+            int32_t to = MIN(end - position, entry_len);
+            memcpy(buffer + len, entry + from, to - from);
+            len += to - from;
+        }
+        position += entry_len;
+    }
+
+    // Check the offset for boundaries of the resource data
+    if(start >= position) {
+        coap_set_status_code(response, BAD_OPTION_4_02);
+        coap_set_payload(response, "BlockOutOfScope", 15);
+        return;
+    }
+
+    etag[0] = (uint8_t)(seq >> 24);
+    etag[1] = (uint8_t)(seq >> 16);
+    etag[2] = (uint8_t)(seq >> 8);
+    etag[3] = (uint8_t)seq;
+
+    coap_set_header_content_format(response, APPLICATION_JSON);
+    coap_set_header_etag(response, etag, sizeof(etag));
+    coap_set_payload(response, buffer, len);
+
+    // Signal the next block to the engine, or the end of the representation
+    *offset += len;
+    if(*offset >= position) {
+        *offset = -1;
+    }
+}
@@ -1,5 +1,8 @@
+#include <stdlib.h>
+#include <string.h>
 #include "contiki.h"
 #include "coap-engine.h"
+#include "coap-observe.h"
 #include "sys/log.h"
 #include "sys/etimer.h"
 #include "lib/random.h" 
@@ -9,38 +12,367 @@
 #define LOG_MODULE "Glucose-level"
 #define LOG_LEVEL LOG_LEVEL_APP
 
-//Declaration of the GET handler function
+//Declaration of the GET and event handler functions
 static void glucose_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void glucose_event_handler(void);
 
 
 /**CoAP resource definition for glucose level sensor.
- * This defines a CoAP resource named `res_glucose_sensor` with the title "Glucose Level".
+ * This defines an observable CoAP resource named `res_glucose_sensor` with the title "Glucose Level".
  * It supports the GET method, which is handled by the `glucose_get_handler` function.
+ * The sensing process calls `res_glucose_sensor.trigger()` after every new sample,
+ * so observers receive the reading as soon as it is taken.
  */
-RESOURCE(res_glucose_sensor,
+EVENT_RESOURCE(res_glucose_sensor,
          "title=\"Glucose Level\";obs",
          glucose_get_handler,
          NULL,
          NULL,
-         NULL);
+         NULL,
+         glucose_event_handler);
+
+
+/* Conditional observe attributes of one observer, set with the query of the
+ * observe registration (e.g. "glucose/level?pmin=10&pmax=300&step=5&lt=70&gt=180"):
+ *  - pmin: minimum time between two notifications, in seconds
+ *  - pmax: maximum time between two notifications, in seconds (0: no limit)
+ *  - step: minimum change of the glucose level since the last notification
+ *  - lt/gt: notify when the glucose level crosses below lt or above gt
+ * Without step, lt and gt every sample is a change worth notifying.
+ */
+struct observer_conditions {
+    coap_endpoint_t endpoint;   // observer the attributes belong to
+    bool used;                  // slot in use
+    uint16_t pmin;
+    uint16_t pmax;
+    uint16_t step;
+    int16_t lt;
+    int16_t gt;
+    bool has_lt;
+    bool has_gt;
+    int16_t last_level;         // glucose level of the last notification
+    uint32_t last_time;         // uptime in seconds of the last notification
+    unsigned int format;        // content format asked for with Accept
+};
+
+//One slot per observer the engine can hold, kept in static memory
+static struct observer_conditions conditions[COAP_MAX_OBSERVERS];
+
+
+/* Reads the numeric variable `name` of the request query.
+ * Returns true and stores the number in `value` if the variable is present and valid.
+ */
+static bool get_query_number(coap_message_t *request, const char *name, long *value) {
+    const char *text = NULL;
+    char number[7]; // Buffer to store the value (max 6 characters + null terminator)
+    char *end;
+    size_t len = coap_get_query_variable(request, name, &text);
+
+    if(len == 0 || len >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, text, len);
+    number[len] = '\0';
+    *value = strtol(number, &end, 10);
+    return *end == '\0';
+}
+
+
+/* Stores the conditional attributes of an observe registration.
+ * A new registration of the same endpoint replaces the previous one; when
+ * the table is full the slot with the oldest notification is reused.
+ */
+static void add_observer_conditions(coap_message_t *request, unsigned int format) {
+    const coap_endpoint_t *endpoint = coap_get_src_endpoint(request);
+    struct observer_conditions *slot = NULL;
+    long value = 0;
+    uint8_t i;
+
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(conditions[i].used && coap_endpoint_cmp(&conditions[i].endpoint, endpoint)) {
+            slot = &conditions[i];
+            break;
+        }
+        if(slot == NULL || !conditions[i].used ||
+           (slot->used && conditions[i].last_time < slot->last_time)) {
+            slot = &conditions[i];
+        }
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    coap_endpoint_copy(&slot->endpoint, endpoint);
+    slot->used = true;
+    slot->format = format;
+    if(get_query_number(request, "pmin", &value) && value > 0) {
+        slot->pmin = value;
+    }
+    if(get_query_number(request, "pmax", &value) && value > 0) {
+        slot->pmax = value;
+    }
+    if(get_query_number(request, "step", &value) && value > 0) {
+        slot->step = value;
+    }
+    slot->has_lt = get_query_number(request, "lt", &value);
+    slot->lt = value;
+    slot->has_gt = get_query_number(request, "gt", &value);
+    slot->gt = value;
+
+    // The registration response carries the current value
+    slot->last_level = glucose_level;
+    slot->last_time = clock_seconds();
+}
+
+
+/* Removes the conditional attributes of an observer that cancelled its registration. */
+static void remove_observer_conditions(coap_message_t *request) {
+    uint8_t i;
+
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(conditions[i].used && coap_endpoint_cmp(&conditions[i].endpoint, coap_get_src_endpoint(request))) {
+            conditions[i].used = false;
+        }
+    }
+}
+
+
+/* Frees the slots of the endpoints that no longer observe glucose/level.
+ * The engine drops an observer on its own, on a RST or when a confirmable
+ * notification times out, and the slot would otherwise force a notification
+ * on every sample.
+ */
+static void prune_observer_conditions(void) {
+    coap_observer_t *obs;
+    bool found;
+    uint8_t i;
+
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(!conditions[i].used) {
+            continue;
+        }
+        found = false;
+        for(obs = list_head(coap_get_observers()); obs != NULL; obs = list_item_next(obs)) {
+            if(strncmp(obs->url, res_glucose_sensor.url, COAP_OBSERVER_URL_LEN) == 0 &&
+               coap_endpoint_cmp(&obs->endpoint, &conditions[i].endpoint)) {
+                found = true;
+                break;
+            }
+        }
+        conditions[i].used = found;
+    }
+}
+
+
+/* Content format of the notifications: the one of the observers, JSON when
+ * there is none. The engine builds one notification per resource for all its
+ * observers, so they all share the same format.
+ */
+static unsigned int notification_format(void) {
+    uint8_t i;
+
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(conditions[i].used) {
+            return conditions[i].format;
+        }
+    }
+    return APPLICATION_JSON;
+}
+
+
+/* True if the endpoint of the request may observe in the given format: the
+ * other observers, if any, use the same one. An observer alone may change it.
+ */
+static bool observer_format_allowed(coap_message_t *request, unsigned int format) {
+    uint8_t i;
+
+    prune_observer_conditions();
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(conditions[i].used && conditions[i].format != format &&
+           !coap_endpoint_cmp(&conditions[i].endpoint, coap_get_src_endpoint(request))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* Checks whether the current glucose level triggers a notification for an observer. */
+static bool observer_condition_met(const struct observer_conditions *c, uint32_t now) {
+    uint32_t elapsed = now - c->last_time;
+
+    if(elapsed < c->pmin) {
+        return false;
+    }
+    if(c->pmax > 0 && elapsed >= c->pmax) {
+        return true;
+    }
+    if(c->step == 0 && !c->has_lt && !c->has_gt) {
+        return true;
+    }
+    if(c->step > 0 && abs(glucose_level - c->last_level) >= c->step) {
+        return true;
+    }
+    if(c->has_lt && (glucose_level < c->lt) != (c->last_level < c->lt)) {
+        return true;
+    }
+    if(c->has_gt && (glucose_level > c->gt) != (c->last_level > c->gt)) {
+        return true;
+    }
+    return false;
+}
+
+
+/* Encodes a CBOR unsigned or negative integer (major types 0 and 1) into buffer.
+ * Returns the number of bytes written.
+ */
+static size_t cbor_put_int(uint8_t *buffer, int32_t value) {
+    uint8_t major = 0x00;
+    uint32_t arg = (uint32_t)value;
+
+    if(value < 0) {
+        major = 0x20;
+        arg = (uint32_t)(-1 - value);
+    }
+    if(arg < 24) {
+        buffer[0] = major | arg;
+        return 1;
+    } else if(arg <= 0xff) {
+        buffer[0] = major | 24;
+        buffer[1] = arg;
+        return 2;
+    } else if(arg <= 0xffff) {
+        buffer[0] = major | 25;
+        buffer[1] = arg >> 8;
+        buffer[2] = arg;
+        return 3;
+    }
+    buffer[0] = major | 26;
+    buffer[1] = arg >> 24;
+    buffer[2] = arg >> 16;
+    buffer[3] = arg >> 8;
+    buffer[4] = arg;
+    return 5;
+}
 
 
 /* GET_Handler for CoAP GET requests to retrieve glucose level. 
  * It processes incoming GET requests to provide the current glucose level.
- * It formats the glucose level data as a JSON string (I choose the data encoding method) 
- * and sets it as the response payload.
+ * The encoding is selected with the Accept option:
+ *  - APPLICATION_JSON (default): {"patient_Id": 1, "glucose_level": <level>}
+ *  - APPLICATION_CBOR: the map {0: <patient id>, 1: <level>}, 6-7 bytes long
+ * The payload is written straight into the response buffer.
+ * Notifications are built from a request without options, so they use the
+ * format of the observers: all the observers share one format, and an observe
+ * registration asking for another one while others observe is answered 4.06
+ * Not Acceptable, without registering it.
+ * Every response carries the sequence number of the sample as ETag and the
+ * seconds left until the next sample as Max-Age. A request whose ETag matches
+ * the current one is answered 2.03 Valid without payload.
  */
 static void glucose_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
-    char message[40];// Buffer to store the JSON message
-    
-    // Format the glucose level data as JSON
-    snprintf(message, sizeof(message), "{\"patient_Id\": 1, \"glucose_level\": %d}", glucose_level);
-    size_t len = strlen(message); // Calculate the length of the message
-    memcpy(buffer, message, len); // Copy the message to the response buffer
-
-    // Set content format to JSON
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    coap_set_header_etag(response, (uint8_t *)&len, 1);
+    unsigned int accept = APPLICATION_JSON;
+    const struct glucose_sample *last = glucose_history_get(glucose_history_count - 1);
+    uint8_t etag[5];
+    uint32_t seq = 0;
+    uint32_t age;
+    uint32_t max_age = sampling_interval;
+    uint32_t observe;
+    size_t len = 0;
+
+    // Notifications are generated without offset
+    if(offset == NULL) {
+        accept = notification_format();
+    } else {
+        coap_get_header_accept(request, &accept);
+        // An error response does not register the observer either
+        if(accept != APPLICATION_CBOR && accept != APPLICATION_JSON) {
+            coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+            return;
+        }
+        if(coap_get_header_observe(request, &observe)) {
+            if(observe != 0) {
+                remove_observer_conditions(request);
+            } else if(observer_format_allowed(request, accept)) {
+                add_observer_conditions(request, accept);
+            } else {
+                LOG_WARN("Observe registration in another format than the observers refused\n");
+                coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+                return;
+            }
+        }
+    }
+
+    // The ETag is the sequence number of the sample, followed by the format,
+    // since the JSON and CBOR representations of a sample differ
+    if(last != NULL) {
+        seq = last->seq;
+        // The reading stays fresh until the next sample is taken
+        age = glucose_uptime() - last->timestamp;
+        max_age = age < sampling_interval ? sampling_interval - age : 0;
+    }
+    etag[0] = (uint8_t)(seq >> 24);
+    etag[1] = (uint8_t)(seq >> 16);
+    etag[2] = (uint8_t)(seq >> 8);
+    etag[3] = (uint8_t)seq;
+    etag[4] = accept == APPLICATION_CBOR;
+
+    // Revalidation: the client already holds the current reading
+    if(offset != NULL) {
+        const uint8_t *request_etag;
+        if(coap_get_header_etag(request, &request_etag) == sizeof(etag) &&
+           memcmp(request_etag, etag, sizeof(etag)) == 0) {
+            coap_set_status_code(response, VALID_2_03);
+            coap_set_header_etag(response, etag, sizeof(etag));
+            coap_set_header_max_age(response, max_age);
+            return;
+        }
+    }
+
+    if(accept == APPLICATION_CBOR) {
+        // Map with two pairs: 0 -> patient id, 1 -> glucose level
+        buffer[len++] = 0xa2;
+        len += cbor_put_int(buffer + len, 0);
+        len += cbor_put_int(buffer + len, PATIENT_ID);
+        len += cbor_put_int(buffer + len, 1);
+        len += cbor_put_int(buffer + len, glucose_level);
+    } else {
+        // Format the glucose level data as JSON
+        len = snprintf((char *)buffer, preferred_size, "{\"patient_Id\": %d, \"glucose_level\": %d}", PATIENT_ID, glucose_level);
+    }
+
+    coap_set_header_content_format(response, accept);
+    coap_set_header_etag(response, etag, sizeof(etag));
+    coap_set_header_max_age(response, max_age);
     coap_set_payload(response, buffer, len);// Set the response payload
 
 }
+
+
+/* Event handler called when a new glucose sample is available.
+ * It pushes the new reading to the observers when the conditional attributes
+ * of at least one of them are met, or when no attributes are registered.
+ * The engine builds one notification per resource for all its observers, so
+ * the attributes of every observer are refreshed when a notification goes out.
+ */
+static void glucose_event_handler(void) {
+    uint32_t now = clock_seconds();
+    bool registered = false;
+    bool notify = false;
+    uint8_t i;
+
+    prune_observer_conditions();
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if(conditions[i].used) {
+            registered = true;
+            notify = notify || observer_condition_met(&conditions[i], now);
+        }
+    }
+    if(registered && !notify) {
+        return;
+    }
+
+    for(i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        conditions[i].last_level = glucose_level;
+        conditions[i].last_time = now;
+    }
+    coap_notify_observers(&res_glucose_sensor);
+}
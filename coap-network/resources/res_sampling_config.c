@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "global_variables.h"
+#if WITH_PERSISTENCE
+#include "persistence.h"
+#endif
+#include "sys/log.h"
+
+/* Log configuration */
+#define LOG_MODULE "sampling-config"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Bounds accepted for the sampling intervals, in seconds
+#define SAMPLING_INTERVAL_MIN 1
+#define SAMPLING_INTERVAL_MAX 3600
+
+// Declaration of the GET and PUT handler functions
+static void sampling_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void sampling_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+
+/**CoAP resource definition for the adaptive sampling of the glucose sensor.
+ * it defines a CoAP resource named "res_sampling_config" with the title "Sampling"
+ * and resource type "Config". The cloud uses it to read and set the bounds of
+ * the sampling interval and the trend that makes the node sample faster.
+ */
+RESOURCE(res_sampling_config,
+         "title=\"Sampling\";rt=\"Config\"",
+         sampling_get_handler,
+         NULL,
+         sampling_put_handler,
+         NULL);
+
+
+/** Reads the integer variable `name` of the request payload.
+ * Returns 1 and stores the number in `value` if the variable is a number
+ * between 0 and SAMPLING_INTERVAL_MAX, 0 if the variable is absent and -1 if
+ * it is invalid.
+ */
+static int get_number_variable(coap_message_t *request, const char *name, uint16_t *value) {
+	const char *text = NULL;
+	char number[5]; // Buffer to store the value (max 4 digits + null terminator)
+	char *end;
+	long parsed;
+	size_t len = coap_get_post_variable(request, name, &text);
+
+	if(len == 0) {
+		return 0;
+	}
+	if(len >= sizeof(number)) {
+		return -1;
+	}
+	memcpy(number, text, len);
+	number[len] = '\0';
+	parsed = strtol(number, &end, 10);
+	if(*end != '\0' || parsed < 0 || parsed > SAMPLING_INTERVAL_MAX) {
+		return -1;
+	}
+	*value = (uint16_t)parsed;
+	return 1;
+}
+
+
+/** Put_Handler for CoAP PUT requests to configure the adaptive sampling.
+ * It accepts the variables "min" and "max" with the bounds of the sampling
+ * interval in seconds, "rate" with the rate of change in mg/dL per minute and
+ * "margin" with the distance in mg/dL from a controller threshold that switch
+ * the node to the minimum interval, e.g. "min=5&max=60&rate=2&margin=20".
+ * A variable left out keeps its current value. Setting min and max to the same
+ * value gives a fixed sampling interval.
+ * If the request is invalid, it sets the response status to 400 (Bad Request)
+ * and the configuration is left unchanged.
+ */
+static void sampling_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	struct sampling_config config = sampling_config;
+
+	if(get_number_variable(request, "min", &config.min_interval) < 0 ||
+	   get_number_variable(request, "max", &config.max_interval) < 0 ||
+	   get_number_variable(request, "rate", &config.rate) < 0 ||
+	   get_number_variable(request, "margin", &config.margin) < 0 ||
+	   config.min_interval < SAMPLING_INTERVAL_MIN || config.min_interval > config.max_interval) {
+		//set the response status code to 400 (Bad Request)
+		coap_set_status_code(response, BAD_REQUEST_4_00);
+		return;
+	}
+
+	sampling_config = config;
+	sampling_config_changed();
+	LOG_INFO("Sampling every %u to %u s, faster at %u mg/dL/min or within %u mg/dL\n",
+	         config.min_interval, config.max_interval, config.rate, config.margin);
+#if WITH_PERSISTENCE
+	persistence_save();
+#endif
+	coap_set_status_code(response, CHANGED_2_04);
+}
+
+
+/** Get_Handler for CoAP GET requests to read the sampling configuration.
+ * It answers in the same form accepted by the PUT handler, followed by the
+ * interval currently in use.
+ */
+static void sampling_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	int len = snprintf((char *)buffer, preferred_size, "min=%u&max=%u&rate=%u&margin=%u&interval=%u",
+	                   sampling_config.min_interval, sampling_config.max_interval,
+	                   sampling_config.rate, sampling_config.margin, sampling_interval);
+
+	coap_set_header_content_format(response, TEXT_PLAIN);
+	coap_set_payload(response, buffer, MIN(len, preferred_size));
+}
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "coap-engine.h"
+#include "os/dev/leds.h"
+#include "actuators.h"
+#include "global_variables.h"
+#if WITH_MULTICAST
+#include "multicast_group.h"
+#endif
+#include "sys/log.h"
+
+/* Log configuration */
+#define LOG_MODULE "state-control"
+#define LOG_LEVEL LOG_LEVEL_APP
+
+//Maximum number of actuators handled by one command
+#define ACTUATORS_MAX 8
+
+// Declaration of the GET, PUT and event handler functions
+static void state_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void state_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void state_event_handler(void);
+
+
+/**CoAP resource definition for the combined actuator state.
+ * it defines a CoAP resource named "res_state_control" with the title "Actuators"
+ * and resource type "Control". A single PUT sets all the actuators of the table
+ * (insulin pump, glucagon pump and alert) together, a GET returns their states.
+ * The resource is observable: every change of the actuator states, made by
+ * a request or by the on-node controller, is notified to the observers.
+ */
+EVENT_RESOURCE(res_state_control,
+         "title=\"Actuators\";rt=\"Control\";obs",
+         state_get_handler,
+         NULL,
+         state_put_handler,
+         NULL,
+         state_event_handler);
+
+
+/** Reads the variable `name` of the request payload.
+ * Returns 1 and stores the state in `value` if the variable is "ON" or "OFF",
+ * 0 if the variable is absent and -1 if its value is invalid.
+ */
+static int get_status_variable(coap_message_t *request, const char *name, bool *value) {
+	const char *text = NULL;
+	size_t len = coap_get_post_variable(request, name, &text);
+
+	if(len == 0) {
+		return 0;
+	}
+	if(len == 2 && strncmp(text, "ON", len) == 0) {
+		*value = true;
+	} else if(len == 3 && strncmp(text, "OFF", len) == 0) {
+		*value = false;
+	} else {
+		return -1;
+	}
+	return 1;
+}
+
+
+/** Put_Handler for CoAP PUT requests to set the actuator states in one go.
+ * It expects one variable per actuator of the table, named after its key and
+ * with the value "ON" or "OFF", e.g. "insulin=ON&glucagon=OFF&alert=OFF".
+ * A variable left out keeps the current state of its actuator.
+ * All the variables are validated before any actuator is changed, so the
+ * node never applies only part of a command.
+ * If the request is invalid, it sets the response status to 400 (Bad Request).
+ * A request sent to the multicast group of the nodes must be non-confirmable,
+ * and gets no response.
+ */
+static void state_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	bool states[ACTUATORS_MAX];
+	int found = 0;
+	size_t count = MIN(actuators_count(), ACTUATORS_MAX);
+	bool group = false;
+	size_t i;
+
+#if WITH_MULTICAST
+	group = multicast_group_request();
+	// Confirmable requests cannot be sent to a group (RFC 7252, 8.1)
+	if(group && !multicast_group_no_response(request)) {
+		return;
+	}
+#endif
+
+	// Reject the whole command if any value is invalid or none is given
+	for(i = 0; i < count; i++) {
+		int result;
+
+		states[i] = *actuators_get(i)->state;
+		result = get_status_variable(request, actuators_get(i)->key, &states[i]);
+		if(result < 0) {
+			coap_set_status_code(response, BAD_REQUEST_4_00);
+			return;
+		}
+		found += result;
+	}
+	if(found == 0) {
+		coap_set_status_code(response, BAD_REQUEST_4_00);
+		return;
+	}
+
+	// Apply all the states together
+	for(i = 0; i < count; i++) {
+		*actuators_get(i)->state = states[i];
+		printf("%s %s%s\n", actuators_get(i)->title, states[i] ? "ON" : "OFF", group ? " by group" : "");
+	}
+
+	coap_set_status_code(response, CHANGED_2_04);
+	actuators_changed();
+}
+
+
+/** Get_Handler for CoAP GET requests to read the actuator states.
+ * It answers with the states in the same form accepted by the PUT handler.
+ */
+static void state_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+	int len = 0;
+	size_t i;
+
+	for(i = 0; i < actuators_count() && len < preferred_size; i++) {
+		len += snprintf((char *)buffer + len, preferred_size - len, "%s%s=%s", i > 0 ? "&" : "",
+		                actuators_get(i)->key, *actuators_get(i)->state ? "ON" : "OFF");
+	}
+
+	coap_set_header_content_format(response, TEXT_PLAIN);
+	coap_set_payload(response, buffer, MIN(len, preferred_size));
+}
+
+
+/* Event handler called when the actuator states change.
+ * It pushes the new states to every registered observer.
+ */
+static void state_event_handler(void) {
+	coap_notify_observers(&res_state_control);
+}
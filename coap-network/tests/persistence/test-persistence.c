@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "global_variables.h"
+#include "registration.h"
+#include "persistence.h"
+
+/* Saves two states, then restores the newest one, and the older one once the
+ * newest one is corrupted as by a reset in the middle of its write.
+ * Prints "TEST OK" and exits with status 0 on success.
+ */
+
+//Files of the two slots of persistence.c: the first save goes to the second one
+static const char *slot_files[2] = { "glucose.state0", "glucose.state1" };
+
+//State of the node read and written by persistence.c
+bool edge_control_enabled = true;
+int glucose_level = 100;
+struct glucose_thresholds glucose_thresholds;
+struct sampling_config sampling_config = { 5, 60, 2, 10 };
+uint16_t sampling_interval = 5;
+uint8_t glucose_history_count = 0;
+static struct glucose_sample history[GLUCOSE_HISTORY_SIZE];
+
+
+const struct glucose_sample *glucose_history_get(uint8_t index) {
+	return index < glucose_history_count ? &history[index] : NULL;
+}
+
+
+void glucose_history_restore(const struct glucose_sample *samples, uint8_t count,
+                             uint32_t sequence, uint32_t uptime) {
+	memcpy(history, samples, count * sizeof(*samples));
+	glucose_history_count = count;
+}
+
+
+uint32_t glucose_uptime(void) {
+	return clock_seconds();
+}
+
+
+void registration_snapshot(struct registration_snapshot *snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+
+void registration_restore(const struct registration_snapshot *snapshot) {
+}
+
+
+static void check(bool condition, const char *what) {
+	if(!condition) {
+		printf("TEST FAILED: %s\n", what);
+		exit(1);
+	}
+}
+
+
+//Saves the state with the given alert_high threshold
+static void save(int alert_high) {
+	glucose_thresholds.alert_high = alert_high;
+	persistence_save();
+}
+
+
+//Restores the state; returns the alert_high threshold restored, or 0
+static int restore(void) {
+	memset(&glucose_thresholds, 0, sizeof(glucose_thresholds));
+	return persistence_restore() ? glucose_thresholds.alert_high : 0;
+}
+
+
+PROCESS(test_persistence, "Persistence test");
+AUTOSTART_PROCESSES(&test_persistence);
+
+PROCESS_THREAD(test_persistence, ev, data)
+{
+	int fd;
+
+	PROCESS_BEGIN();
+
+	cfs_remove(slot_files[0]);
+	cfs_remove(slot_files[1]);
+	check(restore() == 0, "cold start without files");
+
+	save(250);
+	save(300);
+	check(restore() == 300, "newest state restored");
+
+	// A reset after the open of the second save: the open truncated its slot
+	// and only part of the record got written
+	fd = cfs_open(slot_files[0], CFS_READ | CFS_WRITE);
+	check(fd >= 0, "slot reopened");
+	cfs_write(fd, "torn", 4);
+	cfs_close(fd);
+	check(restore() == 250, "older state restored after a torn write");
+
+	printf("TEST OK\n");
+	exit(0);
+
+	PROCESS_END();
+}
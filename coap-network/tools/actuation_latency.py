@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Time to reach every node with an actuator command, from a Cooja log.
+
+Run the simulation with the border router as node 1, then send the command
+with Cloud_App/group_command.py, either to the group or with --unicast to the
+same nodes, and save the output of the Mote output window (or COOJA.testlog):
+
+    python3 actuation_latency.py cooja.log
+
+Every node prints "<Actuator> Activated" or "Deactivated" when the command
+reaches it, followed by "by group" for a group command; the relay of the
+border router logs "Relayed" when it seeds a group command. The actuations
+closer than --gap seconds make up one command. A command starts when the
+border router relays it, or for unicast commands at the first actuation, and
+is over when the last node has it.
+"""
+import argparse
+import re
+import statistics
+
+LINE = re.compile(r"^(?P<time>[\d:.]+)\s+ID:(?P<node>\d+)\s+(?P<message>.*)$")
+ACTUATION = re.compile(r"(?P<actuator>\w+) (?:Activated|Deactivated)(?P<group> by group)?")
+
+
+def parse_time(text, unit):
+    """Seconds from a "[[hh:]mm:]ss.mmm" time, or from an integer in the given unit."""
+    if ":" in text or "." in text:
+        seconds = 0.0
+        for field in text.split(":"):
+            seconds = seconds * 60 + float(field)
+        return seconds
+    return int(text) / {"us": 1e6, "ms": 1e3}[unit]
+
+
+def read_events(path, unit):
+    """Return the (time, node, kind) events of the log, kind being "relay", "group" or "unicast"."""
+    events = []
+    with open(path) as log:
+        for line in log:
+            match = LINE.match(line.strip())
+            if not match:
+                continue
+            time = parse_time(match["time"], unit)
+            message = match["message"]
+            if "Relayed" in message:
+                events.append((time, int(match["node"]), "relay"))
+            else:
+                actuation = ACTUATION.search(message)
+                if actuation:
+                    events.append((time, int(match["node"]), "group" if actuation["group"] else "unicast"))
+    return events
+
+
+def split_commands(events, gap):
+    """Group the events closer than gap seconds into commands."""
+    commands = []
+    for event in events:
+        if not commands or event[0] - commands[-1][-1][0] > gap:
+            commands.append([])
+        commands[-1].append(event)
+    return commands
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Actuation latency from a Cooja log")
+    parser.add_argument("log", help="saved Mote output or COOJA.testlog")
+    parser.add_argument("--gap", type=float, default=10, help="seconds between two commands")
+    parser.add_argument("--unit", choices=["us", "ms"], default="us", help="unit of integer timestamps")
+    args = parser.parse_args()
+
+    for index, command in enumerate(split_commands(read_events(args.log, args.unit), args.gap), 1):
+        relays = [time for time, _, kind in command if kind == "relay"]
+        actuations = {}
+        for time, node, kind in command:
+            if kind != "relay":
+                actuations.setdefault(node, time)
+        if not actuations:
+            continue
+        kind = "group" if relays else "unicast"
+        start = relays[0] if relays else min(actuations.values())
+        delays = sorted(time - start for time in actuations.values())
+        print(f"command {index} ({kind}): {len(actuations)} nodes reached, "
+              f"all after {delays[-1] * 1000:.0f} ms, median {statistics.median(delays) * 1000:.0f} ms")
+
+
+if __name__ == "__main__":
+    main()
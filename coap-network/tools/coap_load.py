@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""Load harness for the CoAP server of the glucose node.
+
+Sends concurrent GET/PUT traffic to the resources of one node, keeps observe
+relationships open on glucose/level and glucose_control/state, and reports
+requests per second, latency percentiles, the 5.03 (Service Unavailable)
+answers the node gives when its COAP_MAX_OPEN_TRANSACTIONS pool is exhausted,
+and the requests left unanswered.
+
+The harness speaks CoAP over plain UDP sockets, so it only needs Python 3:
+
+    python3 coap_load.py fd00::302:304:506:708 --workers 8 --duration 30
+
+Every request is a confirmable message that is not retransmitted: a request
+without an answer within --timeout seconds is counted as a timeout.
+"""
+import argparse
+import asyncio
+import collections
+import random
+import socket
+import struct
+import time
+
+# CoAP message types, codes and options used by the harness
+TYPE_CON = 0
+TYPE_ACK = 2
+TYPE_RST = 3
+GET = 1
+PUT = 3
+OPTION_OBSERVE = 6
+OPTION_URI_PATH = 11
+OPTION_CONTENT_FORMAT = 12
+OPTION_URI_QUERY = 15
+SERVICE_UNAVAILABLE = (5 << 5) | 3
+
+# Requests of the traffic mix: (weight, method, path, payload)
+REQUESTS = [
+    (4, GET, "glucose/level", None),
+    (1, GET, "glucose/history?since=4294967295", None),
+    (2, GET, "glucose_control/state", None),
+    (1, GET, "glucose_control/config", None),
+    (1, PUT, "glucose_control/config", "high=180&insulin=120&glucagon=70&low=50&auto=ON"),
+    (1, PUT, "glucose_control/alert", "status=OFF"),
+]
+
+# Resources observed during the run
+OBSERVED = ["glucose/level", "glucose_control/state"]
+
+
+def code_name(code):
+    return f"{code >> 5}.{code & 0x1f:02d}"
+
+
+def encode_options(options):
+    """Encode (number, bytes) options, which must be sorted by number."""
+    data = b""
+    last = 0
+    for number, value in options:
+        fields = []
+        for nibble_value in (number - last, len(value)):
+            if nibble_value < 13:
+                fields.append((nibble_value, b""))
+            elif nibble_value < 269:
+                fields.append((13, bytes([nibble_value - 13])))
+            else:
+                fields.append((14, struct.pack("!H", nibble_value - 269)))
+        data += bytes([(fields[0][0] << 4) | fields[1][0]]) + fields[0][1] + fields[1][1] + value
+        last = number
+    return data
+
+
+def encode_request(method, uri, payload, mid, token, observe=False):
+    """Build a confirmable request for uri ("path?query")."""
+    path, _, query = uri.partition("?")
+    options = []
+    if observe:
+        options.append((OPTION_OBSERVE, b""))
+    options += [(OPTION_URI_PATH, segment.encode()) for segment in path.split("/") if segment]
+    if payload is not None:
+        options.append((OPTION_CONTENT_FORMAT, b""))  # text/plain
+    options += [(OPTION_URI_QUERY, item.encode()) for item in query.split("&") if item]
+    message = struct.pack("!BBH", (1 << 6) | (TYPE_CON << 4) | len(token), method, mid) + token
+    message += encode_options(options)
+    if payload is not None:
+        message += b"\xff" + payload.encode()
+    return message
+
+
+def decode_header(data):
+    """Return (type, code, message id, token) of a CoAP message."""
+    first, code, mid = struct.unpack("!BBH", data[:4])
+    token_length = first & 0x0f
+    return (first >> 4) & 0x03, code, mid, data[4:4 + token_length]
+
+
+class LoadProtocol(asyncio.DatagramProtocol):
+    """Matches the answers of the node with the pending requests by token."""
+
+    def __init__(self, stats):
+        self.stats = stats
+        self.pending = {}
+        self.observations = set()
+        self.transport = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if len(data) < 4:
+            return
+        message_type, code, mid, token = decode_header(data)
+        if message_type == TYPE_CON:
+            # Acknowledge confirmable notifications, so the node frees the transaction
+            self.transport.sendto(struct.pack("!BBH", (1 << 6) | (TYPE_ACK << 4), 0, mid), addr)
+        future = self.pending.pop(token, None)
+        if future is not None and not future.done():
+            future.set_result(code)
+        elif token in self.observations:
+            self.stats['notifications'] += 1
+
+
+async def worker(protocol, address, stats, deadline, timeout, tokens):
+    """Send requests of the traffic mix back to back until the deadline."""
+    weights = [request[0] for request in REQUESTS]
+    loop = asyncio.get_running_loop()
+    while time.monotonic() < deadline:
+        _, method, uri, payload = random.choices(REQUESTS, weights)[0]
+        mid, token = next(tokens)
+        future = loop.create_future()
+        protocol.pending[token] = future
+        start = time.monotonic()
+        protocol.transport.sendto(encode_request(method, uri, payload, mid, token), address)
+        try:
+            code = await asyncio.wait_for(future, timeout)
+        except asyncio.TimeoutError:
+            protocol.pending.pop(token, None)
+            stats['timeouts'] += 1
+            continue
+        stats['latencies'].append(time.monotonic() - start)
+        stats['codes'][code_name(code)] += 1
+
+
+def token_generator():
+    mid = random.randrange(0x10000)
+    counter = 0
+    while True:
+        mid = (mid + 1) & 0xffff
+        counter += 1
+        yield mid, struct.pack("!I", counter)
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+async def run(args):
+    address = (args.host, args.port, 0, 0)
+    stats = {'latencies': [], 'codes': collections.Counter(), 'timeouts': 0, 'notifications': 0}
+    loop = asyncio.get_running_loop()
+    transport, protocol = await loop.create_datagram_endpoint(
+        lambda: LoadProtocol(stats), family=socket.AF_INET6, local_addr=("::", 0))
+    tokens = token_generator()
+
+    # Open the observe relationships, each observer with its own token
+    for path in OBSERVED[:args.observers]:
+        mid, token = next(tokens)
+        protocol.observations.add(token)
+        transport.sendto(encode_request(GET, path, None, mid, token, observe=True), address)
+
+    start = time.monotonic()
+    deadline = start + args.duration
+    await asyncio.gather(*(worker(protocol, address, stats, deadline, args.timeout, tokens)
+                           for _ in range(args.workers)))
+    elapsed = time.monotonic() - start
+    transport.close()
+
+    latencies = stats['latencies']
+    answered = len(latencies)
+    sent = answered + stats['timeouts']
+    print(f"{args.workers} workers, {elapsed:.1f} s: {sent} requests, {answered} answered")
+    print(f"throughput: {answered / elapsed:.1f} requests/s")
+    if latencies:
+        print(f"latency: p50 {percentile(latencies, 0.50) * 1000:.1f} ms, "
+              f"p99 {percentile(latencies, 0.99) * 1000:.1f} ms, max {max(latencies) * 1000:.1f} ms")
+    print(f"5.03 (transactions exhausted): {stats['codes'][code_name(SERVICE_UNAVAILABLE)]}")
+    print(f"timeouts: {stats['timeouts']}")
+    print(f"notifications: {stats['notifications']}")
+    print("codes: " + ", ".join(f"{code} x{count}" for code, count in sorted(stats['codes'].items())))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="CoAP load harness for the glucose node")
+    parser.add_argument("host", help="IPv6 address of the node")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--workers", type=int, default=4, help="concurrent requests in flight")
+    parser.add_argument("--duration", type=float, default=10, help="length of the run in seconds")
+    parser.add_argument("--timeout", type=float, default=2, help="seconds before a request counts as lost")
+    parser.add_argument("--observers", type=int, default=len(OBSERVED), help="observe relationships to open")
+    args = parser.parse_args()
+    asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+#include "contiki.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/routing/routing.h"
+#include "sys/etimer.h"
+#include "sys/log.h"
+#include "connectivity.h"
+
+/* Log configuration */
+#define LOG_MODULE "connectivity"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+//First delay between the checks while the node has a parent but is not reachable
+//yet, e.g. waiting for the DAO-ACK of the root; doubled up to CONNECTIVITY_MAX_CHECK
+#define CONNECTIVITY_FIRST_CHECK (CLOCK_SECOND / 2)
+#define CONNECTIVITY_MAX_CHECK (CLOCK_SECOND * 16)
+//Interval of the checks when the IPv6 stack gives no route notifications
+#define CONNECTIVITY_FALLBACK_CHECK (CLOCK_SECOND * 5)
+
+process_event_t connectivity_event;
+
+static struct process *subscribers[CONNECTIVITY_MAX_SUBSCRIBERS];
+static uint8_t subscribers_count = 0;
+//Connectivity at the last check
+static bool up = false;
+#if UIP_DS6_NOTIFICATIONS
+static struct uip_ds6_notification route_notification;
+#endif
+
+PROCESS(connectivity_manager, "Connectivity manager");
+
+
+//Checks that the node can reach the root of the DODAG
+static bool check_connectivity() {
+#if CONTIKI_TARGET_NATIVE
+	// The native node reaches the host directly over tun, without a DODAG
+	return true;
+#else
+	return uip_ds6_get_global(ADDR_PREFERRED) != NULL && uip_ds6_defrt_choose() != NULL &&
+	       NETSTACK_ROUTING.node_is_reachable();
+#endif
+}
+
+
+#if UIP_DS6_NOTIFICATIONS
+/** Called by the IPv6 stack when a route changes. RPL sets the default route
+ * to its preferred parent, so the node joins or leaves the DODAG with it.
+ */
+static void route_changed(int event, const uip_ipaddr_t *route, const uip_ipaddr_t *nexthop, int num_routes) {
+	if(event == UIP_DS6_NOTIFICATION_DEFRT_ADD || event == UIP_DS6_NOTIFICATION_DEFRT_RM) {
+		process_poll(&connectivity_manager);
+	}
+}
+#endif
+
+
+void connectivity_subscribe(void) {
+	if(subscribers_count == 0) {
+		connectivity_event = process_alloc_event();
+	}
+	if(subscribers_count < CONNECTIVITY_MAX_SUBSCRIBERS) {
+		subscribers[subscribers_count++] = PROCESS_CURRENT();
+	} else {
+		LOG_ERR("Too many subscribers, %s not added\n", PROCESS_CURRENT()->name);
+	}
+	if(!process_is_running(&connectivity_manager)) {
+		process_start(&connectivity_manager, NULL);
+	}
+}
+
+
+bool connectivity_is_up(void) {
+	return up;
+}
+
+
+/** Checks the connectivity whenever the default route changes, and posts
+ * connectivity_event to the subscribers when it goes up or down. Between two
+ * route changes the process only wakes up while the node has a parent but
+ * is not reachable yet, with an exponential backoff.
+ */
+PROCESS_THREAD(connectivity_manager, ev, data) {
+	static struct etimer check_timer;
+	static clock_time_t check_interval;
+	uint8_t i;
+
+	PROCESS_BEGIN();
+
+#if UIP_DS6_NOTIFICATIONS
+	uip_ds6_notification_add(&route_notification, route_changed);
+#endif
+	check_interval = CONNECTIVITY_FIRST_CHECK;
+
+	while(1) {
+		if(check_connectivity() != up) {
+			up = !up;
+			LOG_INFO("Network %s\n", up ? "up" : "down");
+			for(i = 0; i < subscribers_count; i++) {
+				process_post(subscribers[i], connectivity_event, NULL);
+			}
+		}
+
+		if(!up && uip_ds6_defrt_choose() != NULL) {
+			// Joining: the address or the downward route may still be missing
+			etimer_set(&check_timer, check_interval);
+			check_interval = MIN(check_interval * 2, CONNECTIVITY_MAX_CHECK);
+		} else {
+			check_interval = CONNECTIVITY_FIRST_CHECK;
+#if UIP_DS6_NOTIFICATIONS
+			etimer_stop(&check_timer);
+#else
+			etimer_set(&check_timer, CONNECTIVITY_FALLBACK_CHECK);
+#endif
+		}
+
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || (ev == PROCESS_EVENT_TIMER && data == &check_timer));
+	}
+
+	PROCESS_END();
+}
@@ -0,0 +1,22 @@
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <stdbool.h>
+#include "contiki.h"
+
+//Processes that can subscribe to the connectivity changes
+#define CONNECTIVITY_MAX_SUBSCRIBERS 4
+
+//Posted to the subscribers when the node joins or leaves the network;
+//the new state is given by connectivity_is_up()
+extern process_event_t connectivity_event;
+
+//Subscribes the calling process to connectivity_event, starting the
+//connectivity manager on the first call
+void connectivity_subscribe(void);
+
+//True while the node has a global address and a default route, and the
+//routing protocol reports the root as reachable
+bool connectivity_is_up(void);
+
+#endif /* CONNECTIVITY_H */
@@ -0,0 +1,20 @@
+#ifndef GLUCOSE_GROUP_H
+#define GLUCOSE_GROUP_H
+
+#include "net/ipv6/uip.h"
+
+//Realm-local multicast group joined by the glucose nodes: MPL floods the
+//packets sent to it across the whole DODAG
+#ifdef GLUCOSE_GROUP_CONF_ADDRESS
+#define GLUCOSE_GROUP_ADDRESS(addr) GLUCOSE_GROUP_CONF_ADDRESS(addr)
+#else
+#define GLUCOSE_GROUP_ADDRESS(addr) uip_ip6addr(addr, 0xff03, 0, 0, 0, 0, 0, 0, 0x47)
+#endif
+
+//UDP port where the border router takes the group requests of the collector
+#define GLUCOSE_GROUP_RELAY_PORT 5690
+
+//CoAP port of the nodes
+#define GLUCOSE_GROUP_COAP_PORT 5683
+
+#endif /* GLUCOSE_GROUP_H */
@@ -0,0 +1,53 @@
+#include "contiki.h"
+#if WITH_TSCH
+#include "orchestra.h"
+#include "net/packetbuf.h"
+#include "net/mac/framer/frame802154.h"
+#include "traffic_class.h"
+#include "tsch-profile.h"
+
+/* Orchestra rule of the alert slotframe: one shared cell every
+ * TSCH_PROFILE_ALERT_PERIOD timeslots, taking only the data frames of the
+ * alert traffic class (see traffic_class.h).
+ */
+
+static uint16_t slotframe_handle;
+
+
+static void init(uint16_t handle) {
+	struct tsch_slotframe *slotframe;
+	uint8_t options = LINK_OPTION_TX | LINK_OPTION_SHARED;
+
+	slotframe_handle = handle;
+	slotframe = tsch_schedule_add_slotframe(slotframe_handle, TSCH_PROFILE_ALERT_PERIOD);
+#if !TSCH_PROFILE_SENSOR_ONLY
+	options |= LINK_OPTION_RX;
+#endif
+	tsch_schedule_add_link(slotframe, options, LINK_TYPE_NORMAL, &tsch_broadcast_address,
+	                       0, TSCH_PROFILE_ALERT_CHANNEL_OFFSET, 1);
+}
+
+
+static int select_packet(uint16_t *slotframe, uint16_t *timeslot, uint16_t *channel_offset) {
+	if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) != FRAME802154_DATAFRAME || !traffic_class_is_alert()) {
+		return 0;
+	}
+	if(slotframe != NULL) {
+		*slotframe = slotframe_handle;
+	}
+	if(timeslot != NULL) {
+		*timeslot = 0;
+	}
+	if(channel_offset != NULL) {
+		*channel_offset = TSCH_PROFILE_ALERT_CHANNEL_OFFSET;
+	}
+	return 1;
+}
+
+
+struct orchestra_rule alert_slotframe = {
+	.init = init,
+	.select_packet = select_packet,
+	.name = "alert slotframe",
+};
+#endif /* WITH_TSCH */
@@ -0,0 +1,120 @@
+#include <string.h>
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uipbuf.h"
+#include "traffic_class.h"
+
+//Nesting of traffic_class_alert_begin()
+static uint8_t alert_depth = 0;
+
+//Alert flow of the node
+static struct {
+	uip_ipaddr_t addr;
+	bool any_addr;
+	uint16_t port;        // network byte order, 0 for any port
+	clock_time_t until;
+	bool active;
+} flow;
+
+static enum netstack_ip_action classify_output(const linkaddr_t *localdest);
+
+//Called by the IPv6 stack for every packet sent or forwarded, before 6LoWPAN
+static struct netstack_ip_packet_processor classifier = {
+	.process_output = classify_output,
+};
+
+
+void traffic_class_init(void) {
+	netstack_ip_packet_processor_add(&classifier);
+}
+
+
+void traffic_class_alert_begin(void) {
+	alert_depth++;
+}
+
+
+void traffic_class_alert_end(void) {
+	if(alert_depth > 0) {
+		alert_depth--;
+	}
+}
+
+
+void traffic_class_alert_flow(const uip_ipaddr_t *addr, uint16_t port, clock_time_t duration) {
+	flow.any_addr = addr == NULL;
+	if(addr != NULL) {
+		uip_ipaddr_copy(&flow.addr, addr);
+	}
+	flow.port = UIP_HTONS(port);
+	flow.until = clock_time() + duration;
+	flow.active = true;
+}
+
+
+//DSCP of the packet in the uIP buffer, the upper 6 bits of the Traffic Class
+static uint8_t get_dscp(void) {
+	return (((UIP_IP_BUF->vtc & 0x0f) << 4) | (UIP_IP_BUF->tcflow >> 4)) >> 2;
+}
+
+
+//Sets the DSCP of the packet in the uIP buffer, keeping its ECN bits; the
+//Traffic Class is not covered by the UDP and TCP checksums
+static void set_dscp(uint8_t dscp) {
+	uint8_t tc = (dscp << 2) | ((UIP_IP_BUF->tcflow >> 4) & 0x03);
+
+	UIP_IP_BUF->vtc = (UIP_IP_BUF->vtc & 0xf0) | (tc >> 4);
+	UIP_IP_BUF->tcflow = (UIP_IP_BUF->tcflow & 0x0f) | (tc << 4);
+}
+
+
+//True if the packet in the uIP buffer belongs to the alert flow
+static bool in_alert_flow(void) {
+	uint8_t protocol;
+	uint8_t *header;
+
+	if(!flow.active) {
+		return false;
+	}
+	// The flow is over once the clock reached its end, across wraparounds
+	if((clock_time_t)(clock_time() - flow.until) < (clock_time_t)-1 / 2) {
+		flow.active = false;
+		return false;
+	}
+	if(!flow.any_addr && !uip_ipaddr_cmp(&flow.addr, &UIP_IP_BUF->destipaddr)) {
+		return false;
+	}
+	if(flow.port == 0) {
+		return true;
+	}
+	// The destination port comes at the same offset in UDP and TCP,
+	// after the extension headers such as the RPL and MPL options
+	header = uipbuf_get_last_header(uip_buf, uip_len, &protocol);
+	return header != NULL && (protocol == UIP_PROTO_UDP || protocol == UIP_PROTO_TCP) &&
+	       memcmp(header + 2, &flow.port, sizeof(flow.port)) == 0;
+}
+
+
+/** Tags the alert packets the node sends with the alert DSCP, then gives every
+ * packet carrying it, sent or forwarded, the alert number of transmissions.
+ * The uIP buffer attributes follow the packet down to 6LoWPAN, which copies
+ * them into the packet buffer of the MAC. Nothing else, e.g. RPL, is tagged.
+ */
+static enum netstack_ip_action classify_output(const linkaddr_t *localdest) {
+	if(get_dscp() != TRAFFIC_CLASS_ALERT_DSCP && (alert_depth > 0 || in_alert_flow()) &&
+	   uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)) {
+		set_dscp(TRAFFIC_CLASS_ALERT_DSCP);
+	}
+	if(get_dscp() == TRAFFIC_CLASS_ALERT_DSCP) {
+		uipbuf_set_attr(UIPBUF_ATTR_MAX_MAC_TRANSMISSIONS, TRAFFIC_CLASS_ALERT_TRANSMISSIONS);
+	}
+	return NETSTACK_IP_PROCESS;
+}
+
+
+bool traffic_class_is_alert(void) {
+	return packetbuf_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS) == TRAFFIC_CLASS_ALERT_TRANSMISSIONS;
+}
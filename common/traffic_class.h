@@ -0,0 +1,43 @@
+#ifndef TRAFFIC_CLASS_H
+#define TRAFFIC_CLASS_H
+
+#include <stdbool.h>
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+
+/* Alert and actuator traffic goes through the alert slotframe of the TSCH
+ * profile (see tsch-profile.h) instead of waiting behind the telemetry.
+ * Without TSCH the class only raises the link-layer retries of the packet.
+ *
+ * The class travels in the DSCP of the IPv6 Traffic Class, which 6LoWPAN
+ * (IPHC) carries inline: the node sending an alert packet sets it, and every
+ * node forwarding the packet, border router included, classifies it from
+ * there. The collector sets it on its actuator commands as well.
+ */
+
+//DSCP of the alert traffic: Expedited Forwarding (RFC 3246)
+#define TRAFFIC_CLASS_ALERT_DSCP 46
+
+//Link-layer transmissions of an alert frame: more than the default, and the
+//value tells the alert frames apart once 6LoWPAN hands them to the MAC
+#define TRAFFIC_CLASS_ALERT_TRANSMISSIONS 10
+
+//Classifies every IPv6 packet the node sends or forwards; called once at boot
+void traffic_class_init(void);
+
+//Every packet sent by the node until traffic_class_alert_end() is alert
+//traffic, for the packets sent right away such as UDP
+void traffic_class_alert_begin(void);
+void traffic_class_alert_end(void);
+
+//The packets sent by the node to `port` of `addr` in the next `duration` are
+//alert traffic: for the packets sent after the caller returns, such as the
+//CoAP response to a request or the TCP segments of an MQTT publish.
+//A NULL address matches any address, a port 0 any port. A new flow replaces
+//the previous one.
+void traffic_class_alert_flow(const uip_ipaddr_t *addr, uint16_t port, clock_time_t duration);
+
+//True if the frame being scheduled by the MAC is alert traffic
+bool traffic_class_is_alert(void);
+
+#endif /* TRAFFIC_CLASS_H */
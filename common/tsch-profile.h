@@ -0,0 +1,50 @@
+#ifndef TSCH_PROFILE_H
+#define TSCH_PROFILE_H
+
+/* TSCH build profile of the glucose and CVD nodes and of the border router,
+ * included by their project-conf.h when built with MAKE_WITH_TSCH=1.
+ * Orchestra builds the schedule; the energy/latency trade-off of the periods
+ * is in Documentation/tsch_profile.txt.
+ */
+
+/* Start TSCH at boot: the border router starts the network as RPL root,
+ * the nodes scan for its enhanced beacons */
+#define TSCH_CONF_AUTOSTART 1
+
+/* Period in timeslots of the alert slotframe: an alert frame waits at most
+ * this many timeslots (10 ms each) at every hop */
+#ifdef TSCH_PROFILE_CONF_ALERT_PERIOD
+#define TSCH_PROFILE_ALERT_PERIOD TSCH_PROFILE_CONF_ALERT_PERIOD
+#else
+#define TSCH_PROFILE_ALERT_PERIOD 7
+#endif
+
+/* Channel offset of the alert cell, apart from the other slotframes */
+#define TSCH_PROFILE_ALERT_CHANNEL_OFFSET 2
+
+/* A sensor-only node is an RPL leaf and never listens in the alert cell:
+ * it sends its alerts there, and saves the most frequent wake-up */
+#ifdef TSCH_PROFILE_CONF_SENSOR_ONLY
+#define TSCH_PROFILE_SENSOR_ONLY TSCH_PROFILE_CONF_SENSOR_ONLY
+#else
+#define TSCH_PROFILE_SENSOR_ONLY 0
+#endif
+
+#if TSCH_PROFILE_SENSOR_ONLY
+#define RPL_CONF_LEAF_ONLY 1
+#endif
+
+/* The alert slotframe comes first: it has the lowest handle, so it wins the
+ * timeslots shared with the other slotframes, and its rule sees the frames
+ * first. The periods of the other slotframes are the Orchestra defaults,
+ * which must be the same on every node of the network. */
+#ifndef __ASSEMBLER__
+struct orchestra_rule;
+extern struct orchestra_rule alert_slotframe;
+#endif
+#define ORCHESTRA_CONF_RULES { &alert_slotframe, &eb_per_time_source, &unicast_per_neighbor_rpl_ns, &default_common }
+#define ORCHESTRA_CONF_EBSF_PERIOD 397
+#define ORCHESTRA_CONF_COMMON_SHARED_PERIOD 31
+#define ORCHESTRA_CONF_UNICAST_PERIOD 17
+
+#endif /* TSCH_PROFILE_H */
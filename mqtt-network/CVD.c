@@ -2,7 +2,11 @@
 /*---------------------------------------------------------------------------*/
 #include "contiki.h"
 #include "net/routing/routing.h"
+#if WITH_MQTT_SN
+#include "mqtt-sn.h"
+#else
 #include "mqtt.h"
+#endif
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/ipv6/sicslowpan.h"
@@ -11,8 +15,12 @@
 #include "lib/sensors.h"
 #include "dev/button-hal.h"
 #include "dev/leds.h"
+#include "lib/random.h"
 #include "os/sys/log.h"
 #include "mqtt-client.h"
+#include "connectivity.h"
+#include "traffic_class.h"
+#include "sample_queue.h"
 #include <string.h>
 #include <strings.h>
 #include <stdio.h>
@@ -34,8 +42,58 @@
 static const char *broker_ip = MQTT_CLIENT_BROKER_IP_ADDR;
 
 // Defaukt config values
+#if WITH_MQTT_SN
+// The MQTT-SN gateway in front of the broker
+#define DEFAULT_BROKER_PORT         MQTT_SN_PORT
+#else
 #define DEFAULT_BROKER_PORT         1883
-#define DEFAULT_PUBLISH_INTERVAL    (30 * CLOCK_SECOND)
+#endif
+
+/* Batched publishing: the node takes a sample every CVD_SAMPLE_INTERVAL and
+ * publishes the samples taken since the last publish in one message, every
+ * DEFAULT_PUBLISH_INTERVAL or as soon as CVD_BATCH_SIZE samples are waiting.
+ * A batch size of 1 publishes every sample as soon as it is taken. */
+#ifdef CVD_CONF_SAMPLE_INTERVAL
+#define CVD_SAMPLE_INTERVAL CVD_CONF_SAMPLE_INTERVAL
+#else
+#define CVD_SAMPLE_INTERVAL (1 * CLOCK_SECOND)
+#endif
+
+#ifdef CVD_CONF_BATCH_SIZE
+#define CVD_BATCH_SIZE CVD_CONF_BATCH_SIZE
+#else
+#define CVD_BATCH_SIZE 10
+#endif
+
+#ifdef CVD_CONF_PUBLISH_INTERVAL
+#define DEFAULT_PUBLISH_INTERVAL CVD_CONF_PUBLISH_INTERVAL
+#else
+#define DEFAULT_PUBLISH_INTERVAL (CVD_BATCH_SIZE * CVD_SAMPLE_INTERVAL)
+#endif
+
+/* Store and forward: the samples are published with QoS 1 and stay queued on
+ * the node until their PUBACK (see sample_queue.h). One batch is in flight at
+ * a time. After an outage, the backlog is published one batch at a time, every
+ * CVD_DRAIN_INTERVAL at most, in the turns the live batches leave: a pending
+ * live batch always goes first, after the PUBACK of the batch in flight. */
+#ifdef CVD_CONF_DRAIN_INTERVAL
+#define CVD_DRAIN_INTERVAL CVD_CONF_DRAIN_INTERVAL
+#else
+#define CVD_DRAIN_INTERVAL (2 * CLOCK_SECOND)
+#endif
+// A publish without PUBACK after this delay is lost. Over UDP the batch is
+// published again, and this comes sooner as nothing else recovers it; over
+// TCP the MQTT client takes no other publish until the PUBACK, so the
+// connection is reset
+#ifdef CVD_CONF_PUBACK_TIMEOUT
+#define CVD_PUBACK_TIMEOUT CVD_CONF_PUBACK_TIMEOUT
+#elif WITH_MQTT_SN
+#define CVD_PUBACK_TIMEOUT (5 * CLOCK_SECOND)
+#else
+#define CVD_PUBACK_TIMEOUT (20 * CLOCK_SECOND)
+#endif
+// Delay before trying again a live batch that could not go out yet
+#define CVD_RETRY_INTERVAL (CLOCK_SECOND / 4)
 
 
 
@@ -66,34 +124,91 @@ AUTOSTART_PROCESSES(&CVD_monitoring, &actuator_simulation, &push_button);
 /* Maximum TCP segment size for outgoing segments of our socket */
 #define MAX_TCP_SEGMENT_SIZE    32 // Maximum TCP segment size for outgoing data
 #define CONFIG_IP_ADDR_STR_LEN   64 // Maximum length of an IP address string
-#define JSON_BUFFER_SIZE 256
 /*---------------------------------------------------------------------------*/
 
 
 /*
- * Buffers for Client ID and Topics.
- * Make sure they are large enough to hold the entire respective string
+ * Client ID (the MAC address in hex) and topics.
  */
-#define BUFFER_SIZE 64
-// Buffers to store MQTT client ID, publication topic, and subscription topic
-static char client_id[BUFFER_SIZE];
-static char pub_topic[BUFFER_SIZE];
-static char sub_topic[BUFFER_SIZE];
-
-// Periodic timer to check the state of the MQTT client
-#define STATE_MACHINE_PERIODIC     (CLOCK_SECOND * 1) // Check every 5 seconds
+#define CLIENT_ID_SIZE 13
+static char client_id[CLIENT_ID_SIZE];
+static char pub_topic[] = "Heart/Data";
+static char sub_topic[] = "Emergency_Alert";
+
+// Periodic timer to check the state of the MQTT client, until it is subscribed
+#define STATE_MACHINE_PERIODIC     (CLOCK_SECOND * 1) // Check every second
 static struct etimer periodic_timer;
+// Timers of the sampling and of the batched publishing
+static struct etimer sample_timer;
+static struct etimer publish_timer;
+static struct etimer drain_timer;
+// A live batch waits for the batch in flight: the backlog lets it go first
+static bool live_pending = false;
 
 /*---------------------------------------------------------------------------*/
 
 /*
- * The main MQTT buffers.
- * possible to increase if we start publishing more data.
+ * Payload of the "Heart/Data" publishes: fixed-size binary records, all
+ * fields big-endian.
+ * Header, 14 bytes:
+ *   format (1), patient ID (2), MAC address as in the client ID (6),
+ *   samples dropped (2), samples held (2), number of records (1)
+ * Record, 5 bytes per sample:
+ *   age in seconds at the publish (2), heart rate (1), blood pressure (1),
+ *   button (1)
+ * The format, patient ID and MAC address are written once at boot.
  */
-#define APP_BUFFER_SIZE 512
+#define PAYLOAD_FORMAT       0x01
+#define PAYLOAD_HEADER_SIZE  14
+#define PAYLOAD_RECORD_SIZE  5
+#define PAYLOAD_DYNAMIC      9 // Offset of the counters, after the static part
+#define PAYLOAD_SIZE         (PAYLOAD_HEADER_SIZE + CVD_BATCH_SIZE * PAYLOAD_RECORD_SIZE)
 
-// Buffer to hold the data to be published via MQTT
-static char app_buffer[APP_BUFFER_SIZE];
+#define PATIENT_ID 1
+
+// Payload of the publish being sent: the MQTT client sends it from here
+static uint8_t payload[PAYLOAD_SIZE];
+
+/*
+ * Emergency button fast path: a press is published at once to its own topic,
+ * with QoS 1, ahead of the telemetry, and again every EMERGENCY_RETRY_INTERVAL
+ * until the broker acknowledges it; no batch goes out while it waits for its
+ * first publish.
+ * Over TCP the MQTT client holds one QoS 1 publish at a time, so this holds on
+ * MQTT-SN only: a press coming while a batch waits for its PUBACK is published
+ * after that PUBACK, or after the reconnection if it does not come within
+ * CVD_PUBACK_TIMEOUT, and the retries only go out after a reconnection. The
+ * delay in the payload, and the log, tell such a press apart.
+ * Payload, 16 bytes, big-endian:
+ *   format (1), patient ID (2), MAC address as in the client ID (6), boot (2),
+ *   number of the press (2), milliseconds from the press to this publish (2),
+ *   attempt (1)
+ * The press numbers start again at every boot: the boot, a random number drawn
+ * at boot, tells the presses with the same number apart.
+ */
+#define EMERGENCY_FORMAT         0x03
+#define EMERGENCY_SIZE           16
+#define EMERGENCY_RETRY_INTERVAL (2 * CLOCK_SECOND)
+// Attempts of a press whose PUBACK is still accepted
+#define EMERGENCY_MIDS           8
+
+static char emergency_topic[] = "Heart/Emergency";
+// Posted by the push_button process to CVD_monitoring on a press
+static process_event_t emergency_event;
+static struct etimer emergency_timer;
+static uint8_t emergency_payload[EMERGENCY_SIZE];
+
+// Last press of the button
+static struct {
+  clock_time_t pressed;  // clock_time() of the press
+  clock_time_t sent;     // clock_time() of the last attempt
+  uint16_t boot;         // random at boot, with the press to spot the duplicates
+  uint16_t press;        // number of the press since boot
+  uint16_t mids[EMERGENCY_MIDS]; // message IDs of the last attempts
+  uint8_t attempts;      // publishes since the press, or since the reconnection
+  bool held;             // first publish held behind a publish waiting for its PUBACK
+  bool active;           // not acknowledged yet
+} emergency;
 
 /*---------------------------------------------------------------------------*/
 
@@ -142,6 +257,14 @@ int is_button_pressed() {
 
 /*---------------------------------------------------------------------------*/
 
+// Simulate the heart rate and blood pressure readings and the button status,
+// and queue them for the next publish
+static void take_sample() {
+    sample_queue_add(simulate_heart_rate(), simulate_blood_pressure(), is_button_pressed());
+}
+
+/*---------------------------------------------------------------------------*/
+
 
 /* MQTT publish handler, to handle incoming message from MQTT Broker
 * It recieves message and checks if the recieved topic is "Emergency_Alert"
@@ -169,6 +292,21 @@ static void pub_handler(const char *topic, uint16_t topic_len, const uint8_t *ch
 }
 /*---------------------------------------------------------------------------*/
 
+// True if mid is the message ID of one of the last attempts of the pending press
+static bool emergency_attempt(uint16_t mid) {
+  uint8_t i;
+
+  if(!emergency.active) {
+    return false;
+  }
+  for(i = 0; i < emergency.attempts && i < EMERGENCY_MIDS; i++) {
+    if(emergency.mids[i] == mid) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // MQTT event handler
 static void
 mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
@@ -213,7 +351,18 @@ mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
     break;
   }
   case MQTT_EVENT_PUBACK: {
-    printf("Publishing complete.\n");
+    // The PUBACK of any attempt of the press ends it, a late one included
+    if(emergency_attempt(*((uint16_t *)data))) {
+      // Upper bound of the press-to-broker latency: the PUBACK comes back too
+      LOG_INFO("Emergency %u acknowledged %lu ms after the press (%u attempts)\n",
+               emergency.press, (unsigned long)(clock_time() - emergency.pressed) * 1000 / CLOCK_SECOND,
+               emergency.attempts);
+      emergency.active = false;
+      etimer_stop(&emergency_timer);
+      break;
+    }
+    // The broker has the batch: its samples leave the queue
+    sample_queue_acked(*((uint16_t *)data));
     break;
   }
   default:
@@ -222,16 +371,197 @@ mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
   }
 }
 
-static bool
-have_connectivity(void)
-{
-  if(uip_ds6_get_global(ADDR_PREFERRED) == NULL ||
-     uip_ds6_defrt_choose() == NULL) {
+/*---------------------------------------------------------------------------*/
+
+// Write a 16-bit field, saturated, at p; returns the position after it
+static uint8_t *put_u16(uint8_t *p, unsigned long value) {
+    if(value > 0xffff) {
+        value = 0xffff;
+    }
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+    return p + 2;
+}
+
+// Write the 6 bytes of the MAC address in the client ID at p; returns the
+// position after them
+static uint8_t *put_mac(uint8_t *p) {
+    static const uint8_t bytes[6] = { 0, 1, 2, 5, 6, 7 };
+    uint8_t i;
+
+    for(i = 0; i < sizeof(bytes); i++) {
+        *p++ = linkaddr_node_addr.u8[bytes[i]];
+    }
+    return p;
+}
+
+// Write the static part of the payload header
+static void payload_init() {
+    uint8_t *p = payload;
+
+    *p++ = PAYLOAD_FORMAT;
+    p = put_u16(p, PATIENT_ID);
+    put_mac(p);
+}
+
+/* Publish a batch of samples in one message to the "Heart/Data" topic, with
+ * QoS 1: the samples stay on the node until the PUBACK. The records are
+ * written from the queue straight into the payload; the counters of the queue
+ * go in the header. Returns true if samples are waiting but the MQTT client
+ * could not take them.
+ */
+static bool publish_batch(enum sample_batch_kind kind) {
+    unsigned long now = clock_seconds();
+    const struct cvd_sample *sample;
+    bool button = false;
+    uint16_t first;
+    uint16_t mid;
+    uint8_t count;
+    uint8_t i;
+    uint8_t *p;
+
+    count = sample_queue_select(kind, CVD_BATCH_SIZE, &first);
+    if(count == 0) {
+        return false;
+    }
+    // One batch in flight at a time, the MQTT client sends the payload from
+    // its buffer until it is done, and an emergency not published yet goes first
+    if(sample_queue_in_flight() || !mqtt_ready(&conn) ||
+       (emergency.active && emergency.attempts == 0)) {
+        return true;
+    }
+
+    p = put_u16(payload + PAYLOAD_DYNAMIC, sample_queue_dropped());
+    p = put_u16(p, sample_queue_count());
+    *p++ = count;
+    for(i = 0; i < count; i++) {
+        sample = sample_queue_at(first, i);
+        p = put_u16(p, now - sample->time);
+        *p++ = sample->heart_rate;
+        *p++ = sample->blood_pressure;
+        *p++ = sample->button;
+        button |= sample->button;
+    }
+
+    // An emergency goes out as alert traffic; TCP sends it, and
+    // retransmits it, after mqtt_publish() returns
+    if(button) {
+        traffic_class_alert_flow(NULL, DEFAULT_BROKER_PORT, CLOCK_SECOND * 2);
+    }
+    // Publish the payload to the specified MQTT topic.
+    status = mqtt_publish(&conn, &mid, pub_topic, payload,
+                          p - payload, MQTT_QOS_LEVEL_1, MQTT_RETAIN_OFF);
+    if(status != MQTT_STATUS_OK) {
+        LOG_WARN("Publish failed (status %u), %u samples held\n", status, sample_queue_count());
+        return true;
+    }
+    sample_queue_sent(first, count, mid);
+    LOG_DBG("Published %u %s samples, %u held, %lu dropped\n", count,
+            kind == SAMPLE_BATCH_LIVE ? "live" : "backlog", sample_queue_count(), sample_queue_dropped());
     return false;
-  }
-  return true;
 }
 
+/* Checks the QoS 1 publishes waiting for their PUBACK. Over UDP a batch
+ * waiting for longer than CVD_PUBACK_TIMEOUT is published again, an emergency
+ * at its next retry. Over TCP the MQTT client takes no other publish until the
+ * PUBACK comes, so without it the connection is reset: the reconnection
+ * publishes the emergency and the samples again. Returns true on a reset.
+ */
+static bool puback_overdue() {
+    bool late = sample_queue_expire(CVD_PUBACK_TIMEOUT);
+
+#if !WITH_MQTT_SN
+    late |= emergency.active && emergency.attempts > 0 &&
+            clock_time() - emergency.sent > CVD_PUBACK_TIMEOUT;
+    if(late) {
+        LOG_WARN("No PUBACK in %lu s, connection reset\n",
+                 (unsigned long)(CVD_PUBACK_TIMEOUT / CLOCK_SECOND));
+        state = STATE_DISCONNECTED;
+        process_poll(&CVD_monitoring);
+        return true;
+    }
+#endif
+    return false;
+}
+
+/* Publish the newest samples and schedule the next live batch, soon if it
+ * could not go out, e.g. behind a backlog batch in flight: no backlog batch
+ * goes out while it is pending, so the live batch waits for the PUBACK of one
+ * backlog batch at most. Starts the drain when an outage left a backlog.
+ */
+static void publish_live() {
+    if(puback_overdue()) {
+        return;
+    }
+    live_pending = publish_batch(SAMPLE_BATCH_LIVE);
+    if(live_pending) {
+        etimer_set(&publish_timer, CVD_RETRY_INTERVAL);
+    } else {
+        etimer_set(&publish_timer, DEFAULT_PUBLISH_INTERVAL);
+    }
+    if(etimer_expired(&drain_timer) && sample_queue_backlog(DEFAULT_PUBLISH_INTERVAL / CLOCK_SECOND)) {
+        LOG_INFO("Draining %u samples held\n", sample_queue_count());
+        etimer_set(&drain_timer, CVD_DRAIN_INTERVAL);
+    }
+}
+
+/* Publish the last press of the button to the "Heart/Emergency" topic, with
+ * the delay since the press. Returns false if the MQTT client could not take
+ * it.
+ */
+static bool publish_emergency() {
+    unsigned long delay = (unsigned long)(clock_time() - emergency.pressed) * 1000 / CLOCK_SECOND;
+    uint16_t mid;
+    uint8_t *p = emergency_payload;
+
+    if(!mqtt_ready(&conn)) {
+        if(emergency.attempts == 0 && !emergency.held) {
+            LOG_WARN("Emergency %u held, a publish waits for its PUBACK\n", emergency.press);
+            emergency.held = true;
+        }
+        return false;
+    }
+    *p++ = EMERGENCY_FORMAT;
+    p = put_u16(p, PATIENT_ID);
+    p = put_mac(p);
+    p = put_u16(p, emergency.boot);
+    p = put_u16(p, emergency.press);
+    p = put_u16(p, delay);
+    *p++ = emergency.attempts + 1;
+
+    traffic_class_alert_flow(NULL, DEFAULT_BROKER_PORT, CLOCK_SECOND * 2);
+    status = mqtt_publish(&conn, &mid, emergency_topic, emergency_payload,
+                          p - emergency_payload, MQTT_QOS_LEVEL_1, MQTT_RETAIN_OFF);
+    if(status != MQTT_STATUS_OK) {
+        return false;
+    }
+    emergency.mids[emergency.attempts % EMERGENCY_MIDS] = mid;
+    emergency.sent = clock_time();
+    if(emergency.attempts++ == 0) {
+        LOG_INFO("Emergency %u published %lu ms after the press%s\n", emergency.press, delay,
+                 emergency.held ? ", held behind a publish" : "");
+    }
+    return true;
+}
+
+/* Publish the pending emergency and schedule its next attempt: the retry if
+ * it went out, soon if the MQTT client was busy. Without connection, the
+ * emergency waits for the subscription.
+ */
+static void send_emergency() {
+    if(!emergency.active || state != STATE_SUBSCRIBED) {
+        etimer_stop(&emergency_timer);
+        return;
+    }
+    etimer_set(&emergency_timer, publish_emergency() ? EMERGENCY_RETRY_INTERVAL : CVD_RETRY_INTERVAL);
+}
+
+// True when a whole batch of new samples waits for the live publish
+static bool live_batch_full() {
+    uint16_t first;
+
+    return sample_queue_select(SAMPLE_BATCH_LIVE, CVD_BATCH_SIZE, &first) == CVD_BATCH_SIZE;
+}
 
 /*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
 
@@ -242,6 +572,8 @@ have_connectivity(void)
  * monitoring application within a constrained embedded environment.
  * It handles network connectivity, MQTT communication, sensor data simulation, 
  * and emergency alert subscriptions.
+ * Sampling runs on its own timer, whatever the state of the connection; the
+ * samples are published in batches once the client is subscribed.
  *
  */
 PROCESS_THREAD(CVD_monitoring, ev, data)
@@ -252,10 +584,14 @@ PROCESS_THREAD(CVD_monitoring, ev, data)
   printf("MQTT Client Process\n");
 
   // Initialize the ClientID as MAC address
-  snprintf(client_id, BUFFER_SIZE, "%02x%02x%02x%02x%02x%02x",
+  snprintf(client_id, CLIENT_ID_SIZE, "%02x%02x%02x%02x%02x%02x",
                      linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
                      linkaddr_node_addr.u8[2], linkaddr_node_addr.u8[5],
                      linkaddr_node_addr.u8[6], linkaddr_node_addr.u8[7]);
+  // Static part of the payload, the same in every publish
+  payload_init();
+  // Alert traffic of the node and of the nodes it forwards for
+  traffic_class_init();
 
   // Broker registration					 
   mqtt_register(&conn, &CVD_monitoring, client_id, mqtt_event,
@@ -264,21 +600,54 @@ PROCESS_THREAD(CVD_monitoring, ev, data)
   				  
   // Initial state of the connection state machine.
   state=STATE_INIT;
-				    
-  // Initialize periodic timer to check the status 
-  etimer_set(&periodic_timer, STATE_MACHINE_PERIODIC);
+
+  // The connectivity manager wakes the process as soon as the node joins the network
+  connectivity_subscribe();
+
+  emergency_event = process_alloc_event();
+  emergency.boot = random_rand();
+
+  etimer_set(&sample_timer, CVD_SAMPLE_INTERVAL);
 
   /* Main loop */
   while(1) {
 
     PROCESS_YIELD();
 
+    // A press of the button, or the retry of its publish, goes first
+    if(ev == emergency_event || (ev == PROCESS_EVENT_TIMER && data == &emergency_timer)) {
+		send_emergency();
+    }
+
+    if(ev == PROCESS_EVENT_TIMER && data == &sample_timer) {
+		etimer_reset(&sample_timer);
+		take_sample();
+		// A full batch does not wait for the publish interval
+		if(state == STATE_SUBSCRIBED && live_batch_full()) {
+			publish_live();
+		}
+    }
+
+    if(ev == PROCESS_EVENT_TIMER && data == &publish_timer && state == STATE_SUBSCRIBED) {
+		publish_live();
+    }
+
+    // One backlog batch at a time, as long as samples older than the live ones
+    // wait, and never ahead of a pending live batch
+    if(ev == PROCESS_EVENT_TIMER && data == &drain_timer && state == STATE_SUBSCRIBED &&
+       sample_queue_backlog(DEFAULT_PUBLISH_INTERVAL / CLOCK_SECOND)) {
+		if(!live_pending) {
+			publish_batch(SAMPLE_BATCH_DRAIN);
+		}
+		etimer_reset(&drain_timer);
+    }
+
     if((ev == PROCESS_EVENT_TIMER && data == &periodic_timer) || 
-	      ev == PROCESS_EVENT_POLL){
+	      ev == PROCESS_EVENT_POLL || ev == connectivity_event){
 			  			  
 		  // Initial state: check for network connectivity.
 		  if(state==STATE_INIT){
-			 if(have_connectivity()==true)  
+			 if(connectivity_is_up())
 				 state = STATE_NET_OK;
 		  } 
 		  
@@ -299,8 +668,6 @@ PROCESS_THREAD(CVD_monitoring, ev, data)
 		  if(state==STATE_CONNECTED){
 		  
 			  // Subscribe to a topic
-			  strcpy(sub_topic,"Emergency_Alert");
-
 			  status = mqtt_subscribe(&conn, NULL, sub_topic, MQTT_QOS_LEVEL_0);
 
 			  printf("Subscribing!\n");
@@ -310,51 +677,38 @@ PROCESS_THREAD(CVD_monitoring, ev, data)
 			  }
 			  
 			  state = STATE_SUBSCRIBED;
+			  // Subscribed to the topic: publish a pending emergency first, then
+			  // the newest samples, then one batch per publish interval, and
+			  // drain the samples of the outage
+			  send_emergency();
+			  publish_live();
 		  }
-		// Subscribed to the topic, simulate sensor data and publish it  			  
-		if(state == STATE_SUBSCRIBED){
-			/* 
-			 * Publish simulated sensors data to the "Heart/Data" MQTT topic.
-			 * This section simulates sensor readings, formats them into a JSON payload,
-			 * and publishes the data to the specified topic.
-			 */		  
-		    int patientId = 001;
-		    // Retrieve the device's MAC address for client identification.
-		    uint8_t* mac = linkaddr_node_addr.u8; 
-    			snprintf(client_id, BUFFER_SIZE, "%02x%02x%02x%02x%02x%02x", 
-            		         mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-            	// Simulate blood pressure and heart rate readings and button status         
-		    int button = is_button_pressed();
-		    int blood_pressure = simulate_blood_pressure();
-		    int heart_rate = simulate_heart_rate();
-		  
-		    
-		     sprintf(pub_topic, "%s", "Heart/Data");
-		// Format the sensor data into a JSON payload	
-		sprintf(app_buffer, 
-			"{\"patientId\":%d,"
-			"\"client_id\":\"%s\"," // Added quotes around %s for client_id
-			"\"heart_rate\":%d,"
-			"\"blood_pressure\":%d,"
-			"\"button\":%d}" 
-			, patientId, client_id, heart_rate, blood_pressure, button);
-			
-			// Publish the JSON payload to the specified MQTT topic.	   	
-			mqtt_publish(&conn, NULL, pub_topic, (uint8_t *)app_buffer,
-               strlen(app_buffer), MQTT_QOS_LEVEL_0, MQTT_RETAIN_OFF);
-		    
 		
-		} else if ( state == STATE_DISCONNECTED ){
+		if ( state == STATE_DISCONNECTED ){
 		   LOG_ERR("Disconnected form MQTT broker\n");	
 		   
 		   // Recover from error
 		   mqtt_disconnect(&conn);
+		   etimer_stop(&publish_timer);
+		   etimer_stop(&drain_timer);
+		   live_pending = false;
+		   // The clean session forgets the publishes waiting for their PUBACK:
+		   // their samples go out again after the reconnection
+		   sample_queue_expire(0);
+		   etimer_stop(&emergency_timer);
+		   emergency.attempts = 0;
                    /* If disconnection occurs the state is changed to STATE_INIT in this way a new connection attempt starts */
 		   state = STATE_INIT;
 		}
 		
-		// Set the periodic timer to trigger the next state machine iteration.
-		etimer_set(&periodic_timer, STATE_MACHINE_PERIODIC);
+		// Set the periodic timer to trigger the next state machine iteration;
+		// without network the process sleeps until the connectivity event,
+		// once subscribed the publish timer takes over
+		if((state == STATE_INIT && !connectivity_is_up()) || state == STATE_SUBSCRIBED) {
+		   etimer_stop(&periodic_timer);
+		} else {
+		   etimer_set(&periodic_timer, STATE_MACHINE_PERIODIC);
+		}
       
     }
 
@@ -469,6 +823,13 @@ PROCESS_THREAD(push_button, ev, data)
         if (ev == button_hal_press_event) {
             button_pressed = true;
             LOG_INFO("Button pressed\n");
+            // Fast path: the press is published at once, not with the next batch
+            emergency.pressed = clock_time();
+            emergency.press++;
+            emergency.attempts = 0;
+            emergency.held = false;
+            emergency.active = true;
+            process_post(&CVD_monitoring, emergency_event, NULL);
             etimer_set(&btn_rest_timer, CLOCK_SECOND * 10);
         }
         else if (ev == PROCESS_EVENT_TIMER && etimer_expired(&btn_rest_timer)) {
@@ -0,0 +1,410 @@
+/*---------------------------------------------------------------------------*/
+#include <string.h>
+#include "contiki.h"
+#include "net/ipv6/simple-udp.h"
+#include "net/ipv6/uiplib.h"
+#include "sys/ctimer.h"
+#include "os/sys/log.h"
+#include "mqtt-sn.h"
+/*---------------------------------------------------------------------------*/
+#define LOG_MODULE "mqtt-sn"
+#define LOG_LEVEL LOG_LEVEL_INFO
+/*---------------------------------------------------------------------------*/
+/* Message types (MQTT-SN 1.2, 5.2.2) */
+#define MSG_CONNECT     0x04
+#define MSG_CONNACK     0x05
+#define MSG_PUBLISH     0x0C
+#define MSG_PUBACK      0x0D
+#define MSG_SUBSCRIBE   0x12
+#define MSG_SUBACK      0x13
+#define MSG_PINGREQ     0x16
+#define MSG_PINGRESP    0x17
+#define MSG_DISCONNECT  0x18
+
+/* Flags (5.3.4) */
+#define FLAG_DUP              0x80
+#define FLAG_QOS_SHIFT        5
+#define FLAG_QOS_MASK         0x60
+#define FLAG_RETAIN           0x10
+#define FLAG_CLEAN_SESSION    0x04
+#define FLAG_TOPIC_PREDEFINED 0x01
+
+#define PROTOCOL_ID  0x01
+#define RC_ACCEPTED  0x00
+
+/* Retransmissions of CONNECT, SUBSCRIBE and PINGREQ (Tretry and Nretry) */
+#define RETRY_INTERVAL (5 * CLOCK_SECOND)
+#define RETRIES        3
+
+#define STATE_DISCONNECTED 0
+#define STATE_CONNECTING   1
+#define STATE_CONNECTED    2
+/*---------------------------------------------------------------------------*/
+/* Topics pre-registered on the gateway: the same IDs are in
+ * Cloud_App/mqtt_sn_gateway.py */
+static const struct {
+  const char *name;
+  uint16_t id;
+} topics[] = {
+  { "Heart/Data", 1 },
+  { "Emergency_Alert", 2 },
+  { "Heart/Emergency", 3 },
+};
+#define TOPICS_COUNT (sizeof(topics) / sizeof(topics[0]))
+
+/* The application has a single connection */
+static struct mqtt_connection *connection;
+static uint8_t packet[MQTT_SN_MAX_PACKET_SIZE];
+/* Payload of the last message received, NUL-terminated */
+static uint8_t received[MQTT_SN_MAX_PACKET_SIZE + 1];
+static struct mqtt_message message;
+static mqtt_event_t reason;
+/*---------------------------------------------------------------------------*/
+static int
+topic_id(const char *name)
+{
+  uint8_t i;
+
+  for(i = 0; i < TOPICS_COUNT; i++) {
+    if(strcmp(topics[i].name, name) == 0) {
+      return topics[i].id;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+topic_name(uint16_t id)
+{
+  uint8_t i;
+
+  for(i = 0; i < TOPICS_COUNT; i++) {
+    if(topics[i].id == id) {
+      return topics[i].name;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put_u16(uint8_t *p, uint16_t value)
+{
+  p[0] = value >> 8;
+  p[1] = value & 0xff;
+  return p + 2;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get_u16(const uint8_t *p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+next_mid(struct mqtt_connection *conn)
+{
+  if(++conn->mid_counter == 0) {
+    conn->mid_counter = 1;
+  }
+  return conn->mid_counter;
+}
+/*---------------------------------------------------------------------------*/
+static void ping(void *ptr);
+
+/* Every message sent to the gateway counts as a keep-alive */
+static void
+send(struct mqtt_connection *conn, const uint8_t *data, uint8_t length)
+{
+  simple_udp_sendto_port(&conn->udp, data, length, &conn->gateway, conn->port);
+  if(conn->state == STATE_CONNECTED && conn->pings == 0) {
+    ctimer_set(&conn->ping_timer, conn->keep_alive * CLOCK_SECOND, ping, conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+connection_lost(struct mqtt_connection *conn, mqtt_event_t why)
+{
+  conn->state = STATE_DISCONNECTED;
+  conn->pending = 0;
+  ctimer_stop(&conn->retry_timer);
+  ctimer_stop(&conn->ping_timer);
+  reason = why;
+  conn->event_callback(conn, MQTT_EVENT_DISCONNECTED, &reason);
+}
+/*---------------------------------------------------------------------------*/
+static void
+retry(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+
+  if(++conn->retries > RETRIES) {
+    LOG_WARN("No answer from the gateway\n");
+    connection_lost(conn, MQTT_EVENT_ERROR);
+    return;
+  }
+  send(conn, conn->request, conn->request_length);
+  ctimer_restart(&conn->retry_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* Sends a request and sends it again until the gateway answers it */
+static void
+send_request(struct mqtt_connection *conn, uint8_t length)
+{
+  conn->pending = conn->request[1];
+  conn->request_length = length;
+  conn->retries = 0;
+  send(conn, conn->request, length);
+  ctimer_set(&conn->retry_timer, RETRY_INTERVAL, retry, conn);
+}
+/*---------------------------------------------------------------------------*/
+/* Keep-alive: a PINGREQ after keep_alive seconds without sending anything,
+ * then every RETRY_INTERVAL until the gateway answers */
+static void
+ping(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  uint8_t request[2] = { 2, MSG_PINGREQ };
+
+  if(conn->pings == RETRIES) {
+    LOG_WARN("Gateway lost\n");
+    connection_lost(conn, MQTT_EVENT_ERROR);
+    return;
+  }
+  conn->pings++;
+  send(conn, request, sizeof(request));
+  ctimer_set(&conn->ping_timer, RETRY_INTERVAL, ping, conn);
+}
+/*---------------------------------------------------------------------------*/
+static void
+receive_publish(struct mqtt_connection *conn, const uint8_t *data, uint16_t length)
+{
+  uint8_t flags = data[2];
+  uint16_t id = get_u16(&data[3]);
+  uint16_t mid = get_u16(&data[5]);
+  const char *name = topic_name(id);
+  uint8_t puback[7] = { 7, MSG_PUBACK };
+
+  if((flags & FLAG_QOS_MASK) == (MQTT_QOS_LEVEL_1 << FLAG_QOS_SHIFT)) {
+    put_u16(put_u16(&puback[2], id), mid);
+    puback[6] = name != NULL ? RC_ACCEPTED : 0x02; /* Rejected: invalid topic ID */
+    send(conn, puback, sizeof(puback));
+  }
+  if(name == NULL) {
+    LOG_WARN("Message on unknown topic %u\n", id);
+    return;
+  }
+
+  strcpy(message.topic, name);
+  message.payload_length = length - 7;
+  memcpy(received, &data[7], message.payload_length);
+  received[message.payload_length] = '\0';
+  message.payload_chunk = received;
+  message.payload_chunk_length = message.payload_length;
+  conn->event_callback(conn, MQTT_EVENT_PUBLISH, &message);
+}
+/*---------------------------------------------------------------------------*/
+static void
+receive(struct simple_udp_connection *c,
+        const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+        const uip_ipaddr_t *receiver_addr, uint16_t receiver_port,
+        const uint8_t *data, uint16_t datalen)
+{
+  struct mqtt_connection *conn = connection;
+  uint16_t mid;
+
+  /* Only the one-byte length field is supported */
+  if(datalen < 2 || data[0] != datalen || !uip_ipaddr_cmp(sender_addr, &conn->gateway)) {
+    return;
+  }
+  /* Any message from the gateway shows that it is alive */
+  if(conn->pings > 0) {
+    conn->pings = 0;
+    ctimer_set(&conn->ping_timer, conn->keep_alive * CLOCK_SECOND, ping, conn);
+  }
+
+  switch(data[1]) {
+  case MSG_CONNACK:
+    if(conn->pending != MSG_CONNECT || datalen < 3) {
+      break;
+    }
+    conn->pending = 0;
+    ctimer_stop(&conn->retry_timer);
+    if(data[2] != RC_ACCEPTED) {
+      LOG_WARN("Connection refused (%u)\n", data[2]);
+      connection_lost(conn, MQTT_EVENT_CONNECTION_REFUSED_ERROR);
+      break;
+    }
+    conn->state = STATE_CONNECTED;
+    ctimer_set(&conn->ping_timer, conn->keep_alive * CLOCK_SECOND, ping, conn);
+    conn->event_callback(conn, MQTT_EVENT_CONNECTED, NULL);
+    break;
+  case MSG_SUBACK:
+    if(conn->pending != MSG_SUBSCRIBE || datalen < 8 ||
+       get_u16(&data[5]) != get_u16(&conn->request[3])) {
+      break;
+    }
+    conn->pending = 0;
+    ctimer_stop(&conn->retry_timer);
+    if(data[7] != RC_ACCEPTED) {
+      LOG_WARN("Subscription refused (%u)\n", data[7]);
+      break;
+    }
+    conn->event_callback(conn, MQTT_EVENT_SUBACK, NULL);
+    break;
+  case MSG_PUBACK:
+    if(datalen < 7) {
+      break;
+    }
+    mid = get_u16(&data[4]);
+    if(data[6] != RC_ACCEPTED) {
+      /* Not acknowledged: the application publishes it again */
+      LOG_WARN("Publish %u refused (%u)\n", mid, data[6]);
+      break;
+    }
+    conn->event_callback(conn, MQTT_EVENT_PUBACK, &mid);
+    break;
+  case MSG_PUBLISH:
+    if(conn->state == STATE_CONNECTED && datalen >= 7) {
+      receive_publish(conn, data, datalen);
+    }
+    break;
+  case MSG_PINGRESP:
+    break;
+  case MSG_DISCONNECT:
+    if(conn->state != STATE_DISCONNECTED) {
+      connection_lost(conn, MQTT_EVENT_DISCONNECTED);
+    }
+    break;
+  default:
+    LOG_DBG("Message type 0x%02x ignored\n", data[1]);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+mqtt_status_t
+mqtt_register(struct mqtt_connection *conn, struct process *app_process,
+              char *client_id, mqtt_event_callback_t event_callback,
+              uint16_t max_segment_size)
+{
+  if(strlen(client_id) > MQTT_SN_MAX_REQUEST_SIZE - 6) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+  memset(conn, 0, sizeof(*conn));
+  conn->client_id = client_id;
+  conn->event_callback = event_callback;
+  connection = conn;
+  simple_udp_register(&conn->udp, MQTT_SN_PORT, NULL, 0, receive);
+  return MQTT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+mqtt_status_t
+mqtt_connect(struct mqtt_connection *conn, char *host, uint16_t port,
+             uint16_t keep_alive, uint8_t clean_session)
+{
+  uint8_t id_length = strlen(conn->client_id);
+  uint8_t *p = conn->request;
+
+  if(conn->state != STATE_DISCONNECTED) {
+    return MQTT_STATUS_OK;
+  }
+  if(uiplib_ipaddrconv(host, &conn->gateway) == 0) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+  conn->port = port;
+  conn->keep_alive = keep_alive;
+  conn->pings = 0;
+  conn->state = STATE_CONNECTING;
+
+  *p++ = 6 + id_length;
+  *p++ = MSG_CONNECT;
+  *p++ = clean_session ? FLAG_CLEAN_SESSION : 0;
+  *p++ = PROTOCOL_ID;
+  p = put_u16(p, keep_alive);
+  memcpy(p, conn->client_id, id_length);
+  send_request(conn, 6 + id_length);
+  return MQTT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+void
+mqtt_disconnect(struct mqtt_connection *conn)
+{
+  uint8_t request[2] = { 2, MSG_DISCONNECT };
+
+  if(conn->state == STATE_CONNECTED) {
+    send(conn, request, sizeof(request));
+  }
+  conn->state = STATE_DISCONNECTED;
+  conn->pending = 0;
+  ctimer_stop(&conn->retry_timer);
+  ctimer_stop(&conn->ping_timer);
+}
+/*---------------------------------------------------------------------------*/
+mqtt_status_t
+mqtt_subscribe(struct mqtt_connection *conn, uint16_t *mid, char *topic,
+               mqtt_qos_level_t qos_level)
+{
+  int id = topic_id(topic);
+  uint8_t *p = conn->request;
+  uint16_t request_mid;
+
+  if(conn->state != STATE_CONNECTED) {
+    return MQTT_STATUS_NOT_CONNECTED_ERROR;
+  }
+  if(id < 0) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+  if(conn->pending != 0) {
+    return MQTT_STATUS_OUT_QUEUE_FULL;
+  }
+  request_mid = next_mid(conn);
+  if(mid != NULL) {
+    *mid = request_mid;
+  }
+
+  *p++ = 7;
+  *p++ = MSG_SUBSCRIBE;
+  *p++ = (qos_level << FLAG_QOS_SHIFT) | FLAG_TOPIC_PREDEFINED;
+  p = put_u16(p, request_mid);
+  put_u16(p, id);
+  send_request(conn, 7);
+  return MQTT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+mqtt_status_t
+mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
+             uint8_t *payload, uint32_t payload_size,
+             mqtt_qos_level_t qos_level, mqtt_retain_t retain)
+{
+  int id = topic_id(topic);
+  uint16_t publish_mid = 0;
+  uint8_t *p = packet;
+
+  if(conn->state != STATE_CONNECTED) {
+    return MQTT_STATUS_NOT_CONNECTED_ERROR;
+  }
+  if(id < 0 || payload_size > MQTT_SN_MAX_PACKET_SIZE - 7) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+  if(qos_level != MQTT_QOS_LEVEL_0) {
+    publish_mid = next_mid(conn);
+  }
+  if(mid != NULL) {
+    *mid = publish_mid;
+  }
+
+  *p++ = 7 + payload_size;
+  *p++ = MSG_PUBLISH;
+  *p++ = (qos_level << FLAG_QOS_SHIFT) | (retain ? FLAG_RETAIN : 0) | FLAG_TOPIC_PREDEFINED;
+  p = put_u16(p, id);
+  p = put_u16(p, publish_mid);
+  memcpy(p, payload, payload_size);
+  send(conn, packet, 7 + payload_size);
+  return MQTT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+bool
+mqtt_ready(struct mqtt_connection *conn)
+{
+  return conn->state == STATE_CONNECTED;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,130 @@
+/*---------------------------------------------------------------------------*/
+#ifndef MQTT_SN_H_
+#define MQTT_SN_H_
+/*---------------------------------------------------------------------------*/
+/* MQTT-SN 1.2 client over UDP, for the build made with MAKE_WITH_MQTT_SN=1.
+ *
+ * It provides the subset of the Contiki-NG MQTT API (os/net/app-layer/mqtt)
+ * used by CVD.c, so that the application is the same over both transports.
+ * The topics are pre-registered on the gateway with fixed topic IDs, see
+ * Cloud_App/mqtt_sn_gateway.py: the node never sends a topic name, and only
+ * these topics can be published to or subscribed to.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "contiki.h"
+#include "net/ipv6/simple-udp.h"
+#include "sys/ctimer.h"
+
+/* UDP port of the client; the gateway usually listens on the same */
+#define MQTT_SN_PORT 1884
+
+/* Largest message, with the one-byte length field */
+#define MQTT_SN_MAX_PACKET_SIZE 255
+/* CONNECT with the longest client ID allowed (23 characters) */
+#define MQTT_SN_MAX_REQUEST_SIZE 29
+#define MQTT_MAX_TOPIC_LENGTH 64
+/*---------------------------------------------------------------------------*/
+typedef enum {
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBACK,
+  MQTT_EVENT_UNSUBACK,
+  MQTT_EVENT_PUBLISH,
+  MQTT_EVENT_PUBACK,
+
+  MQTT_EVENT_ERROR = 0x80,
+  MQTT_EVENT_PROTOCOL_ERROR,
+  MQTT_EVENT_CONNECTION_REFUSED_ERROR,
+} mqtt_event_t;
+
+typedef enum {
+  MQTT_STATUS_OK,
+  MQTT_STATUS_OUT_QUEUE_FULL,
+  MQTT_STATUS_NOT_CONNECTED_ERROR,
+  MQTT_STATUS_INVALID_ARGS_ERROR,
+  MQTT_STATUS_ERROR = 0x80,
+} mqtt_status_t;
+
+typedef enum {
+  MQTT_QOS_LEVEL_0,
+  MQTT_QOS_LEVEL_1,
+} mqtt_qos_level_t;
+
+typedef enum {
+  MQTT_RETAIN_OFF,
+  MQTT_RETAIN_ON,
+} mqtt_retain_t;
+
+typedef enum {
+  MQTT_CLEAN_SESSION_OFF,
+  MQTT_CLEAN_SESSION_ON,
+} mqtt_clean_session_t;
+
+/* Message received on a subscribed topic, always in a single chunk */
+struct mqtt_message {
+  char topic[MQTT_MAX_TOPIC_LENGTH + 1];
+  uint8_t *payload_chunk;
+  uint16_t payload_chunk_length;
+  uint16_t payload_length;
+};
+
+struct mqtt_connection;
+
+typedef void (*mqtt_event_callback_t)(struct mqtt_connection *m,
+                                      mqtt_event_t event,
+                                      void *data);
+
+struct mqtt_connection {
+  struct simple_udp_connection udp;
+  uip_ipaddr_t gateway;
+  uint16_t port;
+  mqtt_event_callback_t event_callback;
+  char *client_id;
+  uint16_t keep_alive;          /* seconds */
+  uint16_t mid_counter;
+  uint8_t state;
+  /* CONNECT or SUBSCRIBE waiting for its answer, sent again on timeout */
+  uint8_t pending;
+  uint8_t retries;
+  uint8_t request[MQTT_SN_MAX_REQUEST_SIZE];
+  uint8_t request_length;
+  /* PINGREQ sent without an answer from the gateway */
+  uint8_t pings;
+  struct ctimer retry_timer;
+  struct ctimer ping_timer;
+};
+/*---------------------------------------------------------------------------*/
+mqtt_status_t mqtt_register(struct mqtt_connection *conn,
+                            struct process *app_process,
+                            char *client_id,
+                            mqtt_event_callback_t event_callback,
+                            uint16_t max_segment_size);
+
+mqtt_status_t mqtt_connect(struct mqtt_connection *conn,
+                           char *host,
+                           uint16_t port,
+                           uint16_t keep_alive,
+                           uint8_t clean_session);
+
+void mqtt_disconnect(struct mqtt_connection *conn);
+
+mqtt_status_t mqtt_subscribe(struct mqtt_connection *conn,
+                             uint16_t *mid,
+                             char *topic,
+                             mqtt_qos_level_t qos_level);
+
+/* The payload is copied into the UDP packet: the buffer is free again as
+ * soon as the function returns */
+mqtt_status_t mqtt_publish(struct mqtt_connection *conn,
+                           uint16_t *mid,
+                           char *topic,
+                           uint8_t *payload,
+                           uint32_t payload_size,
+                           mqtt_qos_level_t qos_level,
+                           mqtt_retain_t retain);
+
+bool mqtt_ready(struct mqtt_connection *conn);
+/*---------------------------------------------------------------------------*/
+#endif /* MQTT_SN_H_ */
+/*---------------------------------------------------------------------------*/
@@ -3,8 +3,18 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 /*---------------------------------------------------------------------------*/
-/* Enable TCP */
+/* Enable TCP, not needed by the MQTT-SN build */
+#if !WITH_MQTT_SN
 #define UIP_CONF_TCP 1
+#endif
+
+/* Default route notifications, which wake up the connectivity manager */
+#define UIP_CONF_DS6_ROUTE_NOTIFICATIONS 1
+
+/* TSCH profile with the alert slotframe, built with MAKE_WITH_TSCH=1 */
+#if WITH_TSCH
+#include "tsch-profile.h"
+#endif
 
 //#define LOG_CONF_LEVEL_IPV6                        LOG_LEVEL_DBG
 //#define LOG_CONF_LEVEL_RPL                         LOG_LEVEL_DBG
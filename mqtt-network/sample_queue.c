@@ -0,0 +1,158 @@
+#include "contiki.h"
+#include "sys/log.h"
+#include "sample_queue.h"
+
+/* Log configuration */
+#define LOG_MODULE "sample-queue"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+//Publish waiting for its PUBACK, over count samples from position first
+struct sample_batch {
+	clock_time_t sent;
+	uint16_t mid;
+	uint16_t first;
+	uint8_t count;
+	bool active;
+};
+
+//Ring of the samples, oldest first
+static struct cvd_sample queue[SAMPLE_QUEUE_SIZE];
+static uint16_t head = 0;
+static uint16_t count = 0;
+static unsigned long dropped = 0;
+
+//The batch in flight
+static struct sample_batch batch;
+
+//Position in the ring of the sample offset from the oldest one
+#define POSITION(offset) ((head + (offset)) % SAMPLE_QUEUE_SIZE)
+
+
+static void set_flags(uint8_t flags) {
+	uint8_t i;
+
+	for(i = 0; i < batch.count; i++) {
+		queue[(batch.first + i) % SAMPLE_QUEUE_SIZE].flags = flags;
+	}
+}
+
+
+//Removes the acknowledged samples at the head of the ring
+static void remove_acked(void) {
+	while(count > 0 && (queue[head].flags & SAMPLE_ACKED)) {
+		head = (head + 1) % SAMPLE_QUEUE_SIZE;
+		count--;
+	}
+}
+
+
+void sample_queue_add(uint8_t heart_rate, uint8_t blood_pressure, uint8_t button) {
+	struct cvd_sample *sample;
+
+	if(count == SAMPLE_QUEUE_SIZE) {
+		// The oldest sample may be in flight: its batch will be published again
+		if(batch.active && (head + SAMPLE_QUEUE_SIZE - batch.first) % SAMPLE_QUEUE_SIZE < batch.count) {
+			set_flags(0);
+			batch.active = false;
+		}
+		head = (head + 1) % SAMPLE_QUEUE_SIZE;
+		count--;
+		dropped++;
+		LOG_WARN("Queue full, oldest sample dropped (%lu so far)\n", dropped);
+	}
+
+	sample = &queue[POSITION(count)];
+	sample->time = clock_seconds();
+	sample->heart_rate = heart_rate;
+	sample->blood_pressure = blood_pressure;
+	sample->button = button;
+	sample->flags = 0;
+	count++;
+}
+
+
+uint8_t sample_queue_select(enum sample_batch_kind kind, uint8_t max, uint16_t *first) {
+	uint16_t i;
+	uint8_t n = 0;
+
+	if(kind == SAMPLE_BATCH_LIVE) {
+		// Newest samples, back to the first one already published
+		for(i = count; i > 0 && n < max && queue[POSITION(i - 1)].flags == 0; i--) {
+			n++;
+		}
+	} else {
+		// Oldest samples, after the ones waiting for their PUBACK
+		for(i = 0; i < count && queue[POSITION(i)].flags != 0; i++);
+		while(i + n < count && n < max && queue[POSITION(i + n)].flags == 0) {
+			n++;
+		}
+	}
+	*first = POSITION(i);
+	return n;
+}
+
+
+const struct cvd_sample *sample_queue_at(uint16_t first, uint8_t i) {
+	return &queue[(first + i) % SAMPLE_QUEUE_SIZE];
+}
+
+
+void sample_queue_sent(uint16_t first, uint8_t size, uint16_t mid) {
+	batch.sent = clock_time();
+	batch.mid = mid;
+	batch.first = first;
+	batch.count = size;
+	batch.active = true;
+	set_flags(SAMPLE_INFLIGHT);
+}
+
+
+bool sample_queue_in_flight(void) {
+	return batch.active;
+}
+
+
+void sample_queue_acked(uint16_t mid) {
+	if(batch.active && batch.mid == mid) {
+		set_flags(SAMPLE_ACKED);
+		batch.active = false;
+		remove_acked();
+		LOG_DBG("%u samples acknowledged, %u held\n", batch.count, count);
+	}
+}
+
+
+bool sample_queue_expire(clock_time_t timeout) {
+	bool late;
+
+	if(!batch.active) {
+		return false;
+	}
+	late = clock_time() - batch.sent > timeout;
+	if(timeout == 0 || late) {
+		if(timeout != 0) {
+			LOG_WARN("No PUBACK for message %u, %u samples to publish again\n", batch.mid, batch.count);
+		}
+		set_flags(0);
+		batch.active = false;
+	}
+	return timeout != 0 && late;
+}
+
+
+bool sample_queue_backlog(unsigned long age) {
+	uint16_t i;
+
+	for(i = 0; i < count && queue[POSITION(i)].flags != 0; i++);
+	return i < count && clock_seconds() - queue[POSITION(i)].time > age;
+}
+
+
+uint16_t sample_queue_count(void) {
+	return count;
+}
+
+
+unsigned long sample_queue_dropped(void) {
+	return dropped;
+}
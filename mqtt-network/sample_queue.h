@@ -0,0 +1,77 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "contiki.h"
+
+//Samples kept on the node until the broker acknowledged them: enough for a
+//5-minute outage at one sample per second, with some margin
+#ifdef SAMPLE_QUEUE_CONF_SIZE
+#define SAMPLE_QUEUE_SIZE SAMPLE_QUEUE_CONF_SIZE
+#else
+#define SAMPLE_QUEUE_SIZE 360
+#endif
+
+//One sample of the CVD node
+struct cvd_sample {
+	unsigned long time;      // clock_seconds() when it was taken
+	uint8_t heart_rate;
+	uint8_t blood_pressure;
+	uint8_t button;
+	uint8_t flags;           // SAMPLE_INFLIGHT, SAMPLE_ACKED
+};
+
+//Published and waiting for its PUBACK
+#define SAMPLE_INFLIGHT 0x01
+//Acknowledged, removed once the older samples are acknowledged too
+#define SAMPLE_ACKED    0x02
+
+/* Batches of samples: the live one carries the newest samples, the drain one
+ * the backlog left by an outage, oldest first. One batch at a time is in
+ * flight, whatever its kind: the MQTT client takes no other QoS 1 publish
+ * until the PUBACK of the last one, so the caller picks which batch goes next.
+ */
+enum sample_batch_kind {
+	SAMPLE_BATCH_LIVE,
+	SAMPLE_BATCH_DRAIN,
+	SAMPLE_BATCH_KINDS
+};
+
+//Adds a sample; a full queue drops its oldest sample to make room
+void sample_queue_add(uint8_t heart_rate, uint8_t blood_pressure, uint8_t button);
+
+//Finds the samples of the next batch of the given kind, up to max samples
+//neither published nor acknowledged: the newest ones for the live batch, the
+//oldest ones for the drain batch. Returns their number, and the position of
+//the first one in *first; 0 if the batch is still in flight.
+uint8_t sample_queue_select(enum sample_batch_kind kind, uint8_t max, uint16_t *first);
+
+//Sample i of a batch starting at first
+const struct cvd_sample *sample_queue_at(uint16_t first, uint8_t i);
+
+//Marks the size samples starting at first as the batch in flight, published
+//with the message ID mid
+void sample_queue_sent(uint16_t first, uint8_t size, uint16_t mid);
+
+//True while a batch waits for its PUBACK
+bool sample_queue_in_flight(void);
+
+//Deletes the samples of the batch acknowledged by the PUBACK of mid
+void sample_queue_acked(uint16_t mid);
+
+//Makes the samples of the batch in flight available for another publish if it
+//waits for longer than timeout, or in any case when timeout is 0. Returns true
+//if a batch waited for longer than timeout.
+bool sample_queue_expire(clock_time_t timeout);
+
+//True if samples older than age seconds wait for a publish
+bool sample_queue_backlog(unsigned long age);
+
+//Samples held on the node, waiting for a publish or a PUBACK
+uint16_t sample_queue_count(void);
+
+//Samples dropped because the queue was full, since boot
+unsigned long sample_queue_dropped(void);
+
+#endif /* SAMPLE_QUEUE_H */
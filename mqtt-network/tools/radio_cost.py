@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Packets, bytes and radio time per reading of the CVD node, from a Cooja run.
+
+Compare the MQTT (TCP) and MQTT-SN (UDP) builds by running the same simulation
+with each, for the same time, and saving:
+- the frames of the Radio messages window, with the "6LoWPAN Analyzer with
+  PCAP" analyzer (File > Save to file), as radio.pcap;
+- for the radio time, the Mote output of a node built with
+  MAKE_WITH_ENERGEST=1, as cooja.log.
+
+    python3 radio_cost.py radio.pcap --log cooja.log --node 2
+
+The frames sent by every node are counted by link-layer source address; the
+acknowledgements of the MAC layer have none and are counted apart. A reading
+is a sample of the CVD node, one every --sample-interval seconds.
+"""
+import argparse
+import re
+import struct
+from collections import defaultdict
+
+PCAP_MAGIC = 0xa1b2c3d4
+ENERGEST_PERIOD = re.compile(r"ID:(?P<node>\d+)\s.*Period summary #\d+ \((?P<seconds>\d+) seconds\)")
+ENERGEST_RADIO = re.compile(r"ID:(?P<node>\d+)\s.*Radio (?P<kind>Tx|Rx)\s*:\s*(?P<on>\d+)/\s*(?P<total>\d+)")
+
+
+def read_pcap(path):
+    """Yield (time, frame) for every frame of a pcap file."""
+    with open(path, "rb") as capture:
+        header = capture.read(24)
+        order = "<" if struct.unpack("<I", header[:4])[0] == PCAP_MAGIC else ">"
+        while True:
+            record = capture.read(16)
+            if len(record) < 16:
+                return
+            seconds, microseconds, length, _ = struct.unpack(order + "IIII", record)
+            yield seconds + microseconds / 1e6, capture.read(length)
+
+
+def source_address(frame):
+    """Link-layer source address of an IEEE 802.15.4 frame, None if it has none."""
+    if len(frame) < 3:
+        return None
+    control = frame[0] | (frame[1] << 8)
+    pan_compression = control & 0x40
+    destination_mode = (control >> 10) & 0x3
+    source_mode = (control >> 14) & 0x3
+    size = {0: 0, 2: 2, 3: 8}
+    position = 3
+    if destination_mode:
+        position += 2 + size[destination_mode]
+    if not source_mode:
+        return None
+    if not pan_compression:
+        position += 2
+    address = frame[position:position + size[source_mode]]
+    return ":".join(f"{byte:02x}" for byte in reversed(address))
+
+
+def radio_seconds(path):
+    """Radio Tx and Rx seconds of every node, from the simple-energest summaries."""
+    seconds = defaultdict(lambda: {"Tx": 0.0, "Rx": 0.0})
+    period = {}
+    with open(path) as log:
+        for line in log:
+            match = ENERGEST_PERIOD.search(line)
+            if match:
+                period[match["node"]] = int(match["seconds"])
+                continue
+            match = ENERGEST_RADIO.search(line)
+            if match and match["node"] in period and int(match["total"]):
+                ratio = int(match["on"]) / int(match["total"])
+                seconds[match["node"]][match["kind"]] += ratio * period[match["node"]]
+    return seconds
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Radio cost per reading from a Cooja run")
+    parser.add_argument("pcap", help="frames saved from the Radio messages window")
+    parser.add_argument("--log", help="Mote output with the simple-energest summaries")
+    parser.add_argument("--node", help="Cooja ID of the CVD node, for the radio time")
+    parser.add_argument("--sample-interval", type=float, default=1.0, help="seconds between two readings")
+    parser.add_argument("--voltage", type=float, default=3.0)
+    parser.add_argument("--tx-ma", type=float, default=4.8, help="radio current when sending (nRF52840, 0 dBm)")
+    parser.add_argument("--rx-ma", type=float, default=4.6, help="radio current when listening (nRF52840)")
+    args = parser.parse_args()
+
+    frames = defaultdict(int)
+    octets = defaultdict(int)
+    first = last = None
+    for time, frame in read_pcap(args.pcap):
+        first = time if first is None else first
+        last = time
+        source = source_address(frame) or "MAC acks"
+        frames[source] += 1
+        octets[source] += len(frame)
+    if first is None:
+        print("No frames in the capture")
+        return
+
+    readings = max(1, int((last - first) / args.sample_interval))
+    print(f"{last - first:.0f} s captured, {readings} readings")
+    print(f"{'source':<24} {'frames':>8} {'bytes':>9} {'frames/reading':>15} {'bytes/reading':>14}")
+    for source in sorted(frames, key=frames.get, reverse=True):
+        print(f"{source:<24} {frames[source]:>8} {octets[source]:>9} "
+              f"{frames[source] / readings:>15.2f} {octets[source] / readings:>14.1f}")
+    print(f"{'all':<24} {sum(frames.values()):>8} {sum(octets.values()):>9} "
+          f"{sum(frames.values()) / readings:>15.2f} {sum(octets.values()) / readings:>14.1f}")
+
+    if args.log and args.node:
+        radio = radio_seconds(args.log).get(args.node)
+        if not radio:
+            print(f"No energest summary of node {args.node} in {args.log}")
+            return
+        millijoules = args.voltage * (radio["Tx"] * args.tx_ma + radio["Rx"] * args.rx_ma)
+        print(f"node {args.node}: radio Tx {radio['Tx'] * 1000 / readings:.2f} ms, "
+              f"Rx {radio['Rx'] * 1000 / readings:.2f} ms, {millijoules / readings:.3f} mJ per reading")
+
+
+if __name__ == "__main__":
+    main()
@@ -51,6 +51,11 @@ PROCESS_THREAD(contiki_ng_br, ev, data)
   process_start(&webserver_nogui_process, NULL);
 #endif /* BORDER_ROUTER_CONF_WEBSERVER */
 
+#if BORDER_ROUTER_CONF_GROUP_RELAY
+  PROCESS_NAME(group_relay_process);
+  process_start(&group_relay_process, NULL);
+#endif /* BORDER_ROUTER_CONF_GROUP_RELAY */
+
   LOG_INFO("Contiki-NG Border Router started\n");
 
   PROCESS_END();
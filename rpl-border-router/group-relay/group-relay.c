@@ -0,0 +1,65 @@
+/*
+ * Relays the group requests of the collector to the multicast group of the
+ * glucose nodes. MPL only floods the packets seeded inside the DODAG, so the
+ * collector sends one non-confirmable CoAP request to the relay port of the
+ * border router, which sends it on to the group as an MPL seed.
+ */
+
+#include "contiki.h"
+#include "net/ipv6/simple-udp.h"
+#include "glucose_group.h"
+#include "traffic_class.h"
+
+/* Log configuration */
+#include "sys/log.h"
+#define LOG_MODULE "Group relay"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+/* CoAP version 1, non-confirmable, in the first byte of the header */
+#define COAP_VERSION_TYPE_MASK 0xf0
+#define COAP_VERSION_1_NON     0x50
+
+static struct simple_udp_connection relay_conn;
+static struct simple_udp_connection group_conn;
+static uip_ipaddr_t group_addr;
+
+PROCESS(group_relay_process, "Group relay");
+/*---------------------------------------------------------------------------*/
+static void
+relay_callback(struct simple_udp_connection *c,
+               const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+               const uip_ipaddr_t *receiver_addr, uint16_t receiver_port,
+               const uint8_t *data, uint16_t datalen)
+{
+  /* Confirmable requests cannot be sent to a group (RFC 7252, 8.1) */
+  if(datalen < 4 || (data[0] & COAP_VERSION_TYPE_MASK) != COAP_VERSION_1_NON) {
+    LOG_WARN("Dropped a request from ");
+    LOG_WARN_6ADDR(sender_addr);
+    LOG_WARN_(": not a non-confirmable CoAP message\n");
+    return;
+  }
+
+  /* MPL keeps a copy of the seed taken before it is tagged, and sends it
+   * again on its own trickle timers: the flow covers the first
+   * retransmissions as well. The nodes forward the tagged copies. */
+  traffic_class_alert_flow(&group_addr, GLUCOSE_GROUP_COAP_PORT, CLOCK_SECOND * 2);
+  simple_udp_sendto(&group_conn, data, datalen, &group_addr);
+  LOG_INFO("Relayed %u bytes from ", datalen);
+  LOG_INFO_6ADDR(sender_addr);
+  LOG_INFO_(" to the group\n");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(group_relay_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  GLUCOSE_GROUP_ADDRESS(&group_addr);
+  /* The packets of the nodes forwarded by the border router keep their class */
+  traffic_class_init();
+  simple_udp_register(&relay_conn, GLUCOSE_GROUP_RELAY_PORT, NULL, 0, relay_callback);
+  simple_udp_register(&group_conn, GLUCOSE_GROUP_COAP_PORT, NULL, GLUCOSE_GROUP_COAP_PORT, NULL);
+  LOG_INFO("Relaying port %u to the glucose group\n", GLUCOSE_GROUP_RELAY_PORT);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -50,4 +50,18 @@
 #define UIP_CONF_TCP 1
 #endif
 
+/* Relay of the collector requests to the multicast group of the glucose nodes */
+#ifndef BORDER_ROUTER_CONF_GROUP_RELAY
+#define BORDER_ROUTER_CONF_GROUP_RELAY 1
+#endif
+
+#if BORDER_ROUTER_CONF_GROUP_RELAY
+#define UIP_MCAST6_CONF_ENGINE UIP_MCAST6_ENGINE_MPL
+#endif
+
+/* TSCH profile with the alert slotframe, built with MAKE_WITH_TSCH=1 */
+#if WITH_TSCH
+#include "tsch-profile.h"
+#endif
+
 #endif /* PROJECT_CONF_H_ */